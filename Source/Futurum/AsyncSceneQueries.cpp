@@ -0,0 +1,217 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "AsyncSceneQueries.h"
+#include "Futurum.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Containers/Ticker.h"
+#include "FuturumCollision.h"
+#include "Components/PrimitiveComponent.h"
+
+DECLARE_CYCLE_STAT(TEXT("Async query continuations"), STAT_AsyncQueryContinuations, STATGROUP_Futurum);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Async queries pending"), STAT_AsyncQueriesPending, STATGROUP_Futurum);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Async queries dropped"), STAT_AsyncQueriesDropped, STATGROUP_Futurum);
+
+namespace
+{
+	const float BenchmarkExplosionRadius = 400.f;
+
+	/** Async half of the explosion benchmark, timed frame by frame until the last cover trace is back */
+	struct FExplosionBenchmark
+	{
+		TWeakObjectPtr<UWorld> World;
+		FAsyncSceneQueries Queries;
+		int32 Explosions = 0;
+		int32 FinishedExplosions = 0;
+		int32 CoverTraces = 0;
+		int32 LostOverlaps = 0;
+		int32 Frames = 0;
+		double BlockingTime = 0.0;
+		double AsyncTime = 0.0;
+		int32 BlockingCoverTraces = 0;
+
+		bool Tick(float DeltaTime)
+		{
+			if (!World.IsValid())
+			{
+				return false;
+			}
+
+			const double Start = FPlatformTime::Seconds();
+			Queries.Tick(World.Get());
+			AsyncTime += FPlatformTime::Seconds() - Start;
+			++Frames;
+
+			if (FinishedExplosions < Explosions)
+			{
+				return true;
+			}
+			UE_LOG(LogFuturum, Log, TEXT("%d explosions on the game thread: blocking %.3f ms with %d cover traces, async %.3f ms with %d cover traces over %d frames, %d overlaps lost"),
+				Explosions, BlockingTime * 1000.0, BlockingCoverTraces, AsyncTime * 1000.0, CoverTraces, Frames, LostOverlaps);
+			return false;
+		}
+	};
+
+	void BenchmarkExplosionQueries(const TArray<FString>& Args, UWorld* World)
+	{
+		const int32 Explosions = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 1000;
+		static const FCollisionObjectQueryParams ObjectParams(FCollisionObjectQueryParams::AllDynamicObjects);
+		static const FCollisionQueryParams Params(SCENE_QUERY_STAT(ExplosionBenchmark), false);
+		const FCollisionShape Sphere = FCollisionShape::MakeSphere(BenchmarkExplosionRadius);
+
+		FRandomStream Random(Explosions);
+		TArray<FVector> Locations;
+		for (int32 Index = 0; Index < Explosions; ++Index)
+		{
+			Locations.Add(FVector(Random.FRandRange(-1250.f, 1250.f), Random.FRandRange(-1250.f, 1250.f), Random.FRandRange(0.f, 500.f)));
+		}
+
+		TSharedRef<FExplosionBenchmark> Benchmark = MakeShared<FExplosionBenchmark>();
+		Benchmark->World = World;
+		Benchmark->Explosions = Explosions;
+
+		// Blocking overlap and a blocking cover trace per component, as ApplyRadialDamage does
+		TArray<FOverlapResult> Overlaps;
+		double Start = FPlatformTime::Seconds();
+		for (const FVector& Location : Locations)
+		{
+			World->OverlapMultiByObjectType(Overlaps, Location, FQuat::Identity, ObjectParams, Sphere, Params);
+			for (const FOverlapResult& Overlap : Overlaps)
+			{
+				if (Overlap.GetComponent())
+				{
+					FHitResult CoverHit;
+					World->LineTraceSingleByChannel(CoverHit, Location, Overlap.GetComponent()->Bounds.Origin, ECC_Visibility, Params);
+					++Benchmark->BlockingCoverTraces;
+				}
+			}
+		}
+		Benchmark->BlockingTime = FPlatformTime::Seconds() - Start;
+
+		// The same work on the async path: issuing, then the continuations and their cover traces on the next frames
+		FExplosionBenchmark* RawBenchmark = &Benchmark.Get();
+		Start = FPlatformTime::Seconds();
+		for (const FVector& Location : Locations)
+		{
+			RawBenchmark->Queries.Overlap(World, World, Location, Sphere, ObjectParams, Params, [RawBenchmark, World, Location](const TArray<FOverlapResult>& AsyncOverlaps)
+			{
+				FLineTraceBatch CoverTraces;
+				for (const FOverlapResult& Overlap : AsyncOverlaps)
+				{
+					if (Overlap.GetComponent())
+					{
+						CoverTraces.Add(Location, Overlap.GetComponent()->Bounds.Origin);
+					}
+				}
+				RawBenchmark->CoverTraces += CoverTraces.Num();
+				CoverTraces.Run(World, RawBenchmark->Queries, World, ECC_Visibility, Params, [RawBenchmark](const TArray<FHitResult>& CoverHits)
+				{
+					++RawBenchmark->FinishedExplosions;
+				});
+			},
+			[RawBenchmark]()
+			{
+				++RawBenchmark->LostOverlaps;
+				++RawBenchmark->FinishedExplosions;
+			});
+		}
+		Benchmark->AsyncTime = FPlatformTime::Seconds() - Start;
+
+		FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([Benchmark](float DeltaTime)
+		{
+			return Benchmark->Tick(DeltaTime);
+		}));
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs BenchmarkExplosionQueriesCommand(
+	TEXT("Futurum.BenchExplosionQueries"),
+	TEXT("Times the game thread cost of explosion overlaps and their cover traces, blocking against async up to the last continuation. Takes the number of explosions, the async result is logged once it is in."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchmarkExplosionQueries));
+
+void FAsyncSceneQueries::LineTrace(UWorld* World, const UObject* Owner, const FVector& Start, const FVector& End, ECollisionChannel Channel, const FCollisionQueryParams& Params,
+	FTraceContinuation&& Continuation, FLostContinuation&& LostContinuation)
+{
+	FPendingTrace Trace;
+	Trace.Handle = World->AsyncLineTraceByChannel(EAsyncTraceType::Single, Start, End, Channel, Params);
+	Trace.Owner = Owner;
+	Trace.Continuation = MoveTemp(Continuation);
+	Trace.LostContinuation = MoveTemp(LostContinuation);
+	PendingTraces.Add(MoveTemp(Trace));
+	INC_DWORD_STAT(STAT_AsyncQueriesPending);
+}
+
+void FAsyncSceneQueries::Overlap(UWorld* World, const UObject* Owner, const FVector& Location, const FCollisionShape& Shape, const FCollisionObjectQueryParams& ObjectParams, const FCollisionQueryParams& Params,
+	FOverlapContinuation&& Continuation, FLostContinuation&& LostContinuation)
+{
+	FPendingOverlap PendingOverlap;
+	PendingOverlap.Handle = World->AsyncOverlapByObjectType(Location, FQuat::Identity, ObjectParams, Shape, Params);
+	PendingOverlap.Owner = Owner;
+	PendingOverlap.Continuation = MoveTemp(Continuation);
+	PendingOverlap.LostContinuation = MoveTemp(LostContinuation);
+	PendingOverlaps.Add(MoveTemp(PendingOverlap));
+	INC_DWORD_STAT(STAT_AsyncQueriesPending);
+}
+
+void FAsyncSceneQueries::Tick(UWorld* World)
+{
+	SCOPE_CYCLE_COUNTER(STAT_AsyncQueryContinuations);
+
+	// Continuations may start new queries, which can not be finished yet and get skipped
+	for (int32 Index = 0; Index < PendingTraces.Num();)
+	{
+		FTraceDatum Result;
+		const bool bFinished = World->QueryTraceData(PendingTraces[Index].Handle, Result);
+		if (!bFinished && World->IsTraceHandleValid(PendingTraces[Index].Handle, false))
+		{
+			++Index;
+			continue;
+		}
+
+		FPendingTrace Trace = MoveTemp(PendingTraces[Index]);
+		PendingTraces.RemoveAtSwap(Index, 1, false);
+		DEC_DWORD_STAT(STAT_AsyncQueriesPending);
+		if (!bFinished || !Trace.Owner.IsValid())
+		{
+			INC_DWORD_STAT(STAT_AsyncQueriesDropped);
+			if (!bFinished && Trace.Owner.IsValid() && Trace.LostContinuation)
+			{
+				Trace.LostContinuation();
+			}
+			continue;
+		}
+		Trace.Continuation(Result.OutHits.Num() > 0 ? Result.OutHits[0] : FHitResult());
+	}
+
+	for (int32 Index = 0; Index < PendingOverlaps.Num();)
+	{
+		FOverlapDatum Result;
+		const bool bFinished = World->QueryOverlapData(PendingOverlaps[Index].Handle, Result);
+		if (!bFinished && World->IsTraceHandleValid(PendingOverlaps[Index].Handle, true))
+		{
+			++Index;
+			continue;
+		}
+
+		FPendingOverlap PendingOverlap = MoveTemp(PendingOverlaps[Index]);
+		PendingOverlaps.RemoveAtSwap(Index, 1, false);
+		DEC_DWORD_STAT(STAT_AsyncQueriesPending);
+		if (!bFinished || !PendingOverlap.Owner.IsValid())
+		{
+			INC_DWORD_STAT(STAT_AsyncQueriesDropped);
+			if (!bFinished && PendingOverlap.Owner.IsValid() && PendingOverlap.LostContinuation)
+			{
+				PendingOverlap.LostContinuation();
+			}
+			continue;
+		}
+		PendingOverlap.Continuation(Result.OutOverlaps);
+	}
+}
+
+void FAsyncSceneQueries::Reset()
+{
+	DEC_DWORD_STAT_BY(STAT_AsyncQueriesPending, Num());
+	PendingTraces.Reset();
+	PendingOverlaps.Reset();
+}
@@ -0,0 +1,61 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "WorldCollision.h"
+
+class UWorld;
+
+/**
+ * Scene queries run by the physics scene off the game thread, with a continuation called
+ * once the result is in, usually on the next frame. A continuation only runs while its owner
+ * is alive, so it never sees a destroyed owner. Actors and components in the results are weak:
+ * anything destroyed in between comes back as null from GetActor() and GetComponent().
+ * The physics scene only keeps results for a frame, a query whose results were not read in time
+ * is lost and runs its lost continuation instead, if it has one.
+ */
+class FUTURUM_API FAsyncSceneQueries
+{
+public:
+	typedef TFunction<void(const FHitResult& Hit)> FTraceContinuation;
+	typedef TFunction<void(const TArray<FOverlapResult>& Overlaps)> FOverlapContinuation;
+	typedef TFunction<void()> FLostContinuation;
+
+	/** First blocking hit along the segment, or an empty hit */
+	void LineTrace(UWorld* World, const UObject* Owner, const FVector& Start, const FVector& End, ECollisionChannel Channel, const FCollisionQueryParams& Params,
+		FTraceContinuation&& Continuation, FLostContinuation&& LostContinuation = FLostContinuation());
+
+	void Overlap(UWorld* World, const UObject* Owner, const FVector& Location, const FCollisionShape& Shape, const FCollisionObjectQueryParams& ObjectParams, const FCollisionQueryParams& Params,
+		FOverlapContinuation&& Continuation, FLostContinuation&& LostContinuation = FLostContinuation());
+
+	/** Runs the continuations of the finished queries, which may start new ones */
+	void Tick(UWorld* World);
+
+	/** Drops every pending query without running its continuation */
+	void Reset();
+
+	FORCEINLINE int32 Num() const { return PendingTraces.Num() + PendingOverlaps.Num(); }
+
+	FORCEINLINE SIZE_T GetAllocatedSize() const { return PendingTraces.GetAllocatedSize() + PendingOverlaps.GetAllocatedSize(); }
+
+private:
+	struct FPendingTrace
+	{
+		FTraceHandle Handle;
+		TWeakObjectPtr<const UObject> Owner;
+		FTraceContinuation Continuation;
+		FLostContinuation LostContinuation;
+	};
+
+	struct FPendingOverlap
+	{
+		FTraceHandle Handle;
+		TWeakObjectPtr<const UObject> Owner;
+		FOverlapContinuation Continuation;
+		FLostContinuation LostContinuation;
+	};
+
+	TArray<FPendingTrace> PendingTraces;
+	TArray<FPendingOverlap> PendingOverlaps;
+};
@@ -1,6 +1,7 @@
 // Fill out your copyright notice in the Description page of Project Settings.
 
 #include "BallEnemy.h"
+#include "Futurum.h"
 #include "ConstructorHelpers.h"
 #include "Components/StaticMeshComponent.h"
 #include "Components/SphereComponent.h"
@@ -10,7 +11,76 @@
 #include "Engine/Classes/Kismet/GameplayStatics.h"
 #include "Engine/World.h"
 #include "FuturumGameMode.h"
+#include "FuturumGameState.h"
+#include "FrameArena.h"
+#include "EffectPoolComponent.h"
 #include "Net/UnrealNetwork.h"
+#include "UObject/CoreNet.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Enemy explosion impulse"), STAT_EnemyExplosionImpulse, STATGROUP_Futurum);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Ball movement corrections"), STAT_BallMovementCorrections, STATGROUP_Futurum);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Ball movement B/s per enemy per connection"), STAT_BallMovementBytesPerSecond, STATGROUP_Futurum);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Ball stock movement B/s per enemy per connection"), STAT_BallStockMovementBytesPerSecond, STATGROUP_Futurum);
+
+static TAutoConsoleVariable<int32> CVarBallStockMovement(
+	TEXT("Futurum.BallStockMovement"),
+	0,
+	TEXT("Replicates newly spawned balls with the engine movement replication instead of corrections."));
+
+namespace
+{
+	/** One writer for every measure, so measuring a correction does not allocate in the tick */
+	template<typename MovementType>
+	int64 GetSerializedBits(MovementType& Movement)
+	{
+		static FNetBitWriter Writer(nullptr, 1024);
+		Writer.Reset();
+		bool bSuccess = true;
+		Movement.NetSerialize(Writer, nullptr, bSuccess);
+		return Writer.GetNumBits();
+	}
+}
+
+void FBallMovementTraffic::EndFrame(int32 Enemies)
+{
+	WindowBits += FrameBits;
+	WindowStockBits += FrameStockBits;
+	FrameBits = 0;
+	FrameStockBits = 0;
+
+	// Once a second, weigh what each scheme sent to one connection for one enemy
+	const double Now = FPlatformTime::Seconds();
+	if (Now - WindowStart < 1.0)
+	{
+		return;
+	}
+	if (WindowStart != 0.0)
+	{
+		const float Window = Now - WindowStart;
+		const int32 PerEnemy = FMath::Max(Enemies, 1);
+		SET_FLOAT_STAT(STAT_BallMovementBytesPerSecond, WindowBits / 8.f / Window / PerEnemy);
+		SET_FLOAT_STAT(STAT_BallStockMovementBytesPerSecond, WindowStockBits / 8.f / Window / PerEnemy);
+	}
+	WindowBits = 0;
+	WindowStockBits = 0;
+	WindowStart = Now;
+	bSampleStockUpdate = true;
+}
+
+bool FBallMovement::NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess)
+{
+	bool bLocationSuccess = true;
+	bool bVelocitySuccess = true;
+	bool bAngularVelocitySuccess = true;
+	Location.NetSerialize(Ar, Map, bLocationSuccess);
+	Velocity.NetSerialize(Ar, Map, bVelocitySuccess);
+	AngularVelocity.NetSerialize(Ar, Map, bAngularVelocitySuccess);
+	Ar << Time;
+
+	bOutSuccess = bLocationSuccess && bVelocitySuccess && bAngularVelocitySuccess;
+	return true;
+}
 
 // Sets default values
 ABallEnemy::ABallEnemy()
@@ -74,7 +144,8 @@ ABallEnemy::ABallEnemy()
 	CurrentHealth = MaxHealth;
 
 	SetRemoteRoleForBackwardsCompat(ROLE_SimulatedProxy);
-	bReplicateMovement = true;
+	// Movement goes through BallMovement
+	bReplicateMovement = false;
 	bReplicates = true;
 	SetReplicates(true);
 }
@@ -83,99 +154,193 @@ ABallEnemy::ABallEnemy()
 void ABallEnemy::BeginPlay()
 {
 	Super::BeginPlay();
+
+	HitRadius = StaticMesh->Bounds.SphereRadius;
+
+	if (Role == ROLE_Authority && CVarBallStockMovement.GetValueOnGameThread() != 0)
+	{
+		SetReplicateMovement(true);
+	}
+
+	AFuturumGameState* GameState = GetWorld()->GetGameState<AFuturumGameState>();
+	if (GameState)
+	{
+		GameState->RegisterEnemy(this);
+
+		// The health entry may have replicated before the enemy
+		float Health;
+		if (Role < ROLE_Authority && GameState->GetReplicatedEnemyHealth(this, Health))
+		{
+			OnHealthChanged(Health);
+		}
+	}
+}
+
+void ABallEnemy::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	AFuturumGameState* GameState = GetWorld()->GetGameState<AFuturumGameState>();
+	if (GameState)
+	{
+		GameState->UnregisterEnemy(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
 }
 
 // Called every frame
 void ABallEnemy::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
-}
 
-void ABallEnemy::DestroyObject()
-{
 	if (Role == ROLE_Authority)
 	{
-		AFuturumGameMode* GameMode = (AFuturumGameMode*)GetWorld()->GetAuthGameMode();
-		GameMode->EventDispatcher->OnEnemyDestroyed.Broadcast();
+		PositionHistory.Record(GetWorld()->GetTimeSeconds(), GetActorLocation());
+		UpdateBallMovement();
 	}
+}
 
-	UGameplayStatics::SpawnEmitterAtLocation(GetWorld(), Explosion, GetActorLocation());
+void ABallEnemy::RestoreState(const FTransform& Transform, const FVector& Velocity, const FVector& AngularVelocity)
+{
+	SetHealth(MaxHealth);
+	OnHealthChanged(MaxHealth);
+	SetLifeSpan(0.f);
 
-	FireComponent->DeactivateSystem();
-	SparksComponent->DeactivateSystem();
-	FireComponent->SetVisibility(false);
-	SparksComponent->SetVisibility(false);
-	StaticMesh->SetEnableGravity(true);
+	SetActorTransform(Transform, false, nullptr, ETeleportType::TeleportPhysics);
+	StaticMesh->SetPhysicsLinearVelocity(Velocity);
+	StaticMesh->SetPhysicsAngularVelocityInDegrees(AngularVelocity);
+	PositionHistory.Reset();
 
-	TArray<FOverlapResult> Overlaps;
-	FCollisionObjectQueryParams QueryParams;
-	QueryParams.AddObjectTypesToQuery(ECC_WorldDynamic);
-	QueryParams.AddObjectTypesToQuery(ECC_PhysicsBody);
+	// Sends a correction on the next tick
+	BallMovement.Time = 0.f;
+}
 
-	FCollisionShape ExplosionShape;
-	ExplosionShape.SetSphere(5000.f);
-	GetWorld()->OverlapMultiByObjectType(Overlaps, GetActorLocation(), FQuat::Identity, QueryParams, ExplosionShape);
+void ABallEnemy::UpdateBallMovement()
+{
+	AFuturumGameState* GameState = GetWorld()->GetGameState<AFuturumGameState>();
+	const float Now = GetWorld()->GetTimeSeconds();
+	const FVector Location = GetActorLocation();
+	const FVector Velocity = StaticMesh->GetPhysicsLinearVelocity();
 
-	for (FOverlapResult Hit : Overlaps)
+	if (!bReplicateMovement)
 	{
-		UStaticMeshComponent* MeshComponent = Cast<UStaticMeshComponent>((Hit.GetActor())->GetRootComponent());
+		const bool bDiverged = BallMovement.Time == 0.f
+			|| FVector::DistSquared(BallMovement.Extrapolate(Now), Location) > FMath::Square(CorrectionDistance)
+			|| FVector::DistSquared(BallMovement.Velocity, Velocity) > FMath::Square(CorrectionVelocity);
+		if (bDiverged)
+		{
+			BallMovement.Location = Location;
+			BallMovement.Velocity = Velocity;
+			BallMovement.AngularVelocity = StaticMesh->GetPhysicsAngularVelocityInDegrees();
+			BallMovement.Time = Now;
+			INC_DWORD_STAT(STAT_BallMovementCorrections);
+			if (GameState)
+			{
+				GameState->GetBallMovementTraffic().FrameBits += GetSerializedBits(BallMovement);
+			}
+		}
+	}
 
-		if (MeshComponent)
+	// Stock replication sends the whole state at every net update while the ball moves
+	if (GameState && !Velocity.IsNearlyZero())
+	{
+		FBallMovementTraffic& Traffic = GameState->GetBallMovementTraffic();
+		if (Traffic.bSampleStockUpdate)
 		{
-			MeshComponent->AddRadialImpulse(GetActorLocation(), 5000.f, 90000.f, ERadialImpulseFalloff::RIF_Linear);
+			FRepMovement StockMovement;
+			StockMovement.Location = Location;
+			StockMovement.Rotation = GetActorRotation();
+			StockMovement.LinearVelocity = Velocity;
+			StockMovement.AngularVelocity = StaticMesh->GetPhysicsAngularVelocityInDegrees();
+			StockMovement.bRepPhysics = true;
+			Traffic.StockUpdateBits = GetSerializedBits(StockMovement);
+			Traffic.bSampleStockUpdate = false;
 		}
+		const float Updates = FMath::Min(NetUpdateFrequency * GetWorld()->GetDeltaSeconds(), 1.f);
+		Traffic.FrameStockBits += FMath::RoundToInt(Traffic.StockUpdateBits * Updates);
 	}
-	Destroy();
 }
 
-void ABallEnemy::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+void ABallEnemy::OnRep_BallMovement()
 {
-	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+	AFuturumGameState* GameState = GetWorld()->GetGameState<AFuturumGameState>();
+	const float Now = GameState ? GameState->GetServerWorldTimeSeconds() : BallMovement.Time;
 
-	DOREPLIFETIME(ABallEnemy, CurrentHealth);
+	// Small errors are left to the local physics, which keeps the ball moving between corrections
+	const FVector Location = BallMovement.Extrapolate(FMath::Max(Now, BallMovement.Time));
+	if (FVector::DistSquared(Location, GetActorLocation()) > FMath::Square(CorrectionDistance))
+	{
+		SetActorLocation(Location, false, nullptr, ETeleportType::TeleportPhysics);
+	}
+	StaticMesh->SetPhysicsLinearVelocity(BallMovement.Velocity);
+	StaticMesh->SetPhysicsAngularVelocityInDegrees(BallMovement.AngularVelocity);
 }
 
-float ABallEnemy::TakeDamage(float Damage, FDamageEvent const& DamageEvent, AController* EventInstigator, AActor* DamageCauser)
+void ABallEnemy::DestroyObject()
 {
-	if (Role == ROLE_Authority)
+	AFuturumGameMode* GameMode = (AFuturumGameMode*)GetWorld()->GetAuthGameMode();
+	GameMode->EventDispatcher->OnEnemyDestroyed.Broadcast();
+	GameMode->SendCosmeticEvent(Explosion, nullptr, GetActorLocation());
+
+	AFuturumGameState* GameState = GetWorld()->GetGameState<AFuturumGameState>();
+	if (GameState)
 	{
-		if (CurrentHealth <= 0.f)
-			return Super::TakeDamage(Damage, DamageEvent, EventInstigator, DamageCauser);
-		CurrentHealth -= Damage;
-		if (CurrentHealth <= 0.f)
-		{
-			MulticastDestroyObject();
-		}
-		else if (CurrentHealth <= 40.f)
+		SCOPE_CYCLE_COUNTER(STAT_EnemyExplosionImpulse);
+
+		TFrameArray<UStaticMeshComponent*> Bodies;
+		GameState->GetPhysicsBodies().GatherBodies(GetActorLocation(), 5000.f, Bodies);
+		for (UStaticMeshComponent* Body : Bodies)
 		{
-			MulticastPlayDamageEffects();
+			Body->AddRadialImpulse(GetActorLocation(), 5000.f, 90000.f, ERadialImpulseFalloff::RIF_Linear);
 		}
 	}
-	return Super::TakeDamage(Damage, DamageEvent, EventInstigator, DamageCauser);
+	SetLifeSpan(DeathLifeSpan);
 }
 
-void ABallEnemy::PlayDamageEffects()
+void ABallEnemy::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
 {
-	if (!SparksComponent->IsVisible())
-		SparksComponent->SetVisibility(true);
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(ABallEnemy, BallMovement);
 }
 
-void ABallEnemy::MulticastDestroyObject_Implementation()
+float ABallEnemy::TakeDamage(float Damage, FDamageEvent const& DamageEvent, AController* EventInstigator, AActor* DamageCauser)
 {
-	DestroyObject();
+	// Applied with the damage of every other enemy at the next game state tick
+	AFuturumGameState* GameState = GetWorld()->GetGameState<AFuturumGameState>();
+	if (Role == ROLE_Authority && GameState && CurrentHealth > 0.f)
+	{
+		GameState->DamageEnemy(this, Damage);
+	}
+	return Super::TakeDamage(Damage, DamageEvent, EventInstigator, DamageCauser);
 }
 
-bool ABallEnemy::MulticastDestroyObject_Validate()
+void ABallEnemy::SetHealth(float Health)
 {
-	return true;
+	AFuturumGameState* GameState = GetWorld()->GetGameState<AFuturumGameState>();
+	if (GameState)
+	{
+		GameState->SetEnemyHealth(this, Health);
+	}
 }
 
-void ABallEnemy::MulticastPlayDamageEffects_Implementation()
+void ABallEnemy::OnHealthChanged(float Health)
 {
-	PlayDamageEffects();
+	CurrentHealth = Health;
+	UpdateHealthEffects();
 }
 
-bool ABallEnemy::MulticastPlayDamageEffects_Validate()
+void ABallEnemy::UpdateHealthEffects()
 {
-	return true;
+	const bool bDead = CurrentHealth <= 0.f;
+	if (bDead)
+	{
+		FireComponent->DeactivateSystem();
+	}
+	else if (!FireComponent->IsActive())
+	{
+		FireComponent->ActivateSystem();
+	}
+	FireComponent->SetVisibility(!bDead);
+	SparksComponent->SetVisibility(!bDead && CurrentHealth <= FEnemyHealthStore::DamagedHealth);
+	StaticMesh->SetEnableGravity(bDead);
 }
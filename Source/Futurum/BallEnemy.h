@@ -4,8 +4,70 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Character.h"
+#include "EnemyPositionHistory.h"
+#include "Engine/NetSerialization.h"
 #include "BallEnemy.generated.h"
 
+/**
+ * Movement of a ball as sent to clients. Clients carry it forward with their own
+ * physics, the server only sends a new one when the ball strays from it.
+ */
+USTRUCT()
+struct FBallMovement
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FVector_NetQuantize Location;
+
+	UPROPERTY()
+	FVector_NetQuantize Velocity;
+
+	/** Degrees per second */
+	UPROPERTY()
+	FVector_NetQuantize AngularVelocity;
+
+	/** Server world time the state was taken at */
+	UPROPERTY()
+	float Time = 0.f;
+
+	FORCEINLINE FVector Extrapolate(float Now) const { return Location + Velocity * (Now - Time); }
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FBallMovement> : public TStructOpsTypeTraitsBase2<FBallMovement>
+{
+	enum
+	{
+		WithNetSerializer = true
+	};
+};
+
+/**
+ * Movement traffic of every ball of a world, kept by the game state on the server.
+ * Balls add what they send during the frame, the game state folds the frame into the
+ * window once per frame and publishes the window once a second.
+ */
+struct FBallMovementTraffic
+{
+	/** Bits sent for the corrections of this frame, and what stock replication would have sent */
+	int64 FrameBits = 0;
+	int64 FrameStockBits = 0;
+
+	/** Size of one stock movement update, sampled by the first moving ball of every window */
+	int64 StockUpdateBits = 0;
+	bool bSampleStockUpdate = true;
+
+	/** Folds the frame into the window and starts a new frame, publishes the stats per enemy once a second */
+	void EndFrame(int32 Enemies);
+
+private:
+	int64 WindowBits = 0;
+	int64 WindowStockBits = 0;
+	double WindowStart = 0.0;
+};
 
 UCLASS()
 class FUTURUM_API ABallEnemy : public AActor
@@ -22,46 +84,78 @@ public:
 	UPROPERTY(EditAnywhere)
 	class UStaticMeshComponent* StaticMesh = nullptr;
 
-	UPROPERTY(EditAnywhere, Category = AI)
-	class UBehaviorTree* EnemyBehavior = nullptr;
-
 	UPROPERTY(EditAnywhere)
 	class UParticleSystemComponent* FireComponent = nullptr;
 
 	UPROPERTY(EditAnywhere)
 	float MaxHealth = 100.f;
 
-	UPROPERTY(VisibleAnywhere, Replicated)
+	/** Copy of the enemy's entry in the game state health table, which replicates it */
+	UPROPERTY(VisibleAnywhere)
 	float CurrentHealth = 100.f;
 
+	/** Entry in the game state health table, server only */
+	int32 HealthId = INDEX_NONE;
+
+	/** Seconds a dead enemy falls before it is removed, long enough for its health to replicate */
+	UPROPERTY(EditAnywhere)
+	float DeathLifeSpan = 2.f;
+
 	UPROPERTY(VisibleAnywhere, Category=FX)
 	UParticleSystem* Explosion = nullptr;
 
 	UPROPERTY(EditAnywhere)
 	UParticleSystemComponent* SparksComponent = nullptr;
 
+	/** Radius used by the lag compensated hit tests */
+	UPROPERTY(VisibleAnywhere)
+	float HitRadius = 50.f;
+
+	/** Recent locations, recorded on the server for lag compensation */
+	FEnemyPositionHistory PositionHistory;
+
+	/** Distance from the replicated movement after which the server sends a correction */
+	UPROPERTY(EditAnywhere, Category = Replication)
+	float CorrectionDistance = 25.f;
+
+	/** Change of velocity after which the server sends a correction, bounces mostly */
+	UPROPERTY(EditAnywhere, Category = Replication)
+	float CorrectionVelocity = 50.f;
 
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	virtual float TakeDamage(float Damage, FDamageEvent const& DamageEvent, AController* EventInstigator, AActor* DamageCauser) override;
 
 public:	
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
 
-private:
+	/** Puts a live or dying enemy back to full health at the given state, server only */
+	void RestoreState(const FTransform& Transform, const FVector& Velocity, const FVector& AngularVelocity);
 
-	UFUNCTION(NetMulticast, Reliable, WithValidation)
-	void MulticastDestroyObject();
+	/** Sets the health through the game state health table, without damage events. Server only */
+	void SetHealth(float Health);
 
-	UFUNCTION()
+	/** Takes a new health value and shows the effects matching it */
+	void OnHealthChanged(float Health);
+
+	/** Server side of the death, the effects follow CurrentHealth */
 	void DestroyObject();
 
-	UFUNCTION(NetMulticast, Reliable, WithValidation)
-	void MulticastPlayDamageEffects();
-	
+private:
+	UPROPERTY(ReplicatedUsing = OnRep_BallMovement)
+	FBallMovement BallMovement;
+
 	UFUNCTION()
-	void PlayDamageEffects();
+	void OnRep_BallMovement();
+
+	/** Sends a correction when the ball no longer follows BallMovement */
+	void UpdateBallMovement();
+
+	/** Shows the effects matching CurrentHealth */
+	void UpdateHealthEffects();
 };
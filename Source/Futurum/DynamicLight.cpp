@@ -10,16 +10,19 @@
 #include <Runtime/Engine/Classes/Engine/Engine.h>
 #include "Classes/Particles/ParticleSystemComponent.h"
 #include "FuturumGameMode.h"
-#include "Kismet/GameplayStatics.h"
+#include "FuturumGameState.h"
+#include "NetMetrics.h"
+#include "FuturumCollision.h"
+#include "LampField.h"
 #include "Net/UnrealNetwork.h"
 
-#define Interactable ECC_GameTraceChannel2
-
 // Sets default values
 ADynamicLight::ADynamicLight()
 {
- 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
+ 	// Colors are driven by the game state lamp table
+	PrimaryActorTick.bCanEverTick = false;
+	// Lamps live as long as their level, keep them and their components in one GC cluster
+	bCanBeInCluster = true;
 	Root = CreateDefaultSubobject<USceneComponent>(TEXT("Root"));
 	Root->SetMobility(EComponentMobility::Stationary);
 	Mesh = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("Mesh"));
@@ -30,7 +33,7 @@ ADynamicLight::ADynamicLight()
 		Mesh->SetStaticMesh(LampAsset.Object);
 		Mesh->SetMobility(EComponentMobility::Stationary);
 		Mesh->SetCollisionEnabled(ECollisionEnabled::QueryOnly);
-		Mesh->SetCollisionProfileName(TEXT("Interactable"));
+		Mesh->SetCollisionProfileName(FuturumCollision::InteractableProfile);
 	}
 
 	Sparks = CreateDefaultSubobject<UParticleSystemComponent>(TEXT("Sparks"));
@@ -46,7 +49,7 @@ ADynamicLight::ADynamicLight()
 
 	CapsuleCollision = CreateDefaultSubobject<UCapsuleComponent>(TEXT("Capsule collision"));
 	CapsuleCollision->AttachTo(Root);
-	CapsuleCollision->SetCollisionProfileName(TEXT("Interactable"));
+	CapsuleCollision->SetCollisionProfileName(FuturumCollision::InteractableProfile);
 	CapsuleCollision->SetRelativeLocation(FVector(0.f, 0.f, -70.f));
 	CapsuleCollision->SetRelativeScale3D(FVector(1.25f, 1.25f, 2.5f));
 
@@ -59,11 +62,15 @@ ADynamicLight::ADynamicLight()
 	Light->SetMobility(EComponentMobility::Stationary);
 	Light->SetIndirectLightingIntensity(0.01f);
 	Light->SetAttenuationRadius(1200.f);
-	
 
 	SetReplicates(true);
 }
 
+bool ADynamicLight::CanBeInCluster() const
+{
+	return Super::CanBeInCluster() && !ALampField::IsEnabled();
+}
+
 // Called when the game starts or when spawned
 void ADynamicLight::BeginPlay()
 {
@@ -72,31 +79,52 @@ void ADynamicLight::BeginPlay()
 	{
 		AFuturumGameMode* GameMode = (AFuturumGameMode*)GetWorld()->GetAuthGameMode();
 		GameMode->EventDispatcher->OnEnemyDestroyed.AddDynamic(this, &ADynamicLight::TurnOff);
-		GameMode->EventDispatcher->SetLightsState.AddDynamic(this, &ADynamicLight::MulticastSetState);
+		GameMode->EventDispatcher->SetLightsState.AddDynamic(this, &ADynamicLight::SetState);
+
+		AFuturumGameState* GameState = GetWorld()->GetGameState<AFuturumGameState>();
+		if (GameState)
+		{
+			GameState->RegisterLamp(this);
+		}
+	}
+
+	AFuturumGameState* GameState = GetWorld()->GetGameState<AFuturumGameState>();
+	if (GameState)
+	{
+		GameState->RegisterBudgetedLight(Light);
 	}
 }
 
-// Called every frame
-void ADynamicLight::Tick(float DeltaTime)
+void ADynamicLight::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
-	Super::Tick(DeltaTime);
-	if (Role == ROLE_Authority)
+	AFuturumGameState* GameState = GetWorld()->GetGameState<AFuturumGameState>();
+	if (GameState)
 	{
-		TArray<AActor*> FoundActors;
-		UGameplayStatics::GetAllActorsOfClass(GetWorld(), ABallEnemy::StaticClass(), FoundActors);
-		FVector PlayerLocation = FoundActors.Num() != 0 ? FoundActors.Last(0)->GetActorLocation() : FVector::ZeroVector;
-		FVector LampLocation = GetActorLocation();
-		FVector RelativePosition = LampLocation - PlayerLocation;
-		RelativePosition = RelativePosition.GetSafeNormal();
-		float Angle = FMath::Atan2(RelativePosition.X, RelativePosition.Y) + PI;
-		LightColor = FLinearColor(FMath::Cos(Angle) / 2 + 0.5f, FMath::Cos(Angle + 2 * PI / 3) / 2 + 0.5f, FMath::Cos(Angle - 2 * PI / 3) / 2 + 0.5f);
+		GameState->UnregisterLamp(this);
+		GameState->UnregisterBudgetedLight(Light);
 	}
+	Super::EndPlay(EndPlayReason);
+}
+
+void ADynamicLight::OnRep_LightColor()
+{
+	Light->SetLightColor(LightColor);
+}
+
+void ADynamicLight::SetLightColor(const FLinearColor& Color)
+{
+	LightColor = Color;
 	Light->SetLightColor(LightColor);
+	if (Role == ROLE_Authority)
+	{
+		static const UProperty* LightColorProperty = FindFieldChecked<UProperty>(StaticClass(), GET_MEMBER_NAME_CHECKED(ADynamicLight, LightColor));
+		FNetMetrics::Get().RecordProperty(LightColorProperty->GetFName(), this, FNetMetrics::GetPropertySize(LightColorProperty, this));
+	}
 }
 
 void ADynamicLight::Use()
 {
-	MulticastUse();
+	SetState(!bLightOn);
 }
 
 void ADynamicLight::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
@@ -104,48 +132,39 @@ void ADynamicLight::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLif
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
 
 	DOREPLIFETIME(ADynamicLight, LightColor);
+	DOREPLIFETIME(ADynamicLight, bLightOn);
 }
 
 
 float ADynamicLight::TakeDamage(float Damage, FDamageEvent const& DamageEvent, AController* EventInstigator, AActor* DamageCauser)
 {	
-	MulticastUse();
+	SetState(!bLightOn);
 	return Super::TakeDamage(Damage, DamageEvent, EventInstigator, DamageCauser);
 }
 
-void ADynamicLight::MulticastUse_Implementation()
-{
-	ToggleVisibility();
-}
-
-bool ADynamicLight::MulticastUse_Validate()
-{
-	return true;
-}
-
-void ADynamicLight::MulticastSetState_Implementation(bool State)
-{
-	SetState(State);
-}
-
-bool ADynamicLight::MulticastSetState_Validate(bool State)
+void ADynamicLight::OnRep_LightOn()
 {
-	return true;
+	UpdateLightState();
 }
 
 void ADynamicLight::SetState(bool State)
 {
-	Light->SetVisibility(State);
-	Sparks->SetVisibility(!State);
+	bLightOn = State;
+	UpdateLightState();
+	if (Role == ROLE_Authority)
+	{
+		static const UProperty* LightOnProperty = FindFieldChecked<UProperty>(StaticClass(), GET_MEMBER_NAME_CHECKED(ADynamicLight, bLightOn));
+		FNetMetrics::Get().RecordProperty(LightOnProperty->GetFName(), this, FNetMetrics::GetPropertySize(LightOnProperty, this));
+	}
 }
 
 void ADynamicLight::TurnOff()
 {
-	MulticastSetState(false);
+	SetState(false);
 }
 
-void ADynamicLight::ToggleVisibility()
+void ADynamicLight::UpdateLightState()
 {
-	Light->ToggleVisibility();
-	Sparks->ToggleVisibility();
-}
\ No newline at end of file
+	Light->SetVisibility(bLightOn);
+	Sparks->SetVisibility(!bLightOn);
+}
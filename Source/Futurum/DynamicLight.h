@@ -3,15 +3,15 @@
 #pragma once
 
 #include "CoreMinimal.h"
-#include "GameFramework/Actor.h"
 #include "Engine/Classes/Components/PointLightComponent.h"
 #include "Engine/Classes/Components/CapsuleComponent.h"
+#include "InteractableActor.h"
 #include "Interactable.h"
 #include "BallEnemy.h"
 #include "DynamicLight.generated.h"
 
 UCLASS()
-class FUTURUM_API ADynamicLight : public AActor, public IInteractable
+class FUTURUM_API ADynamicLight : public AInteractableActor, public IInteractable
 {
 	GENERATED_BODY()
 	
@@ -19,15 +19,18 @@ public:
 	// Sets default values for this actor's properties
 	ADynamicLight();
 
+	/** Lamps the lamp field strips would dissolve their cluster, only whole lamps are clustered */
+	virtual bool CanBeInCluster() const override;
+
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	virtual float TakeDamage(float Damage, FDamageEvent const& DamageEvent, AController* EventInstigator, AActor* DamageCauser) override;
 
 public:	
-	// Called every frame
-	virtual void Tick(float DeltaTime) override;
 
 	UPROPERTY(EditAnywhere)
 	USceneComponent* Root = nullptr;
@@ -44,24 +47,31 @@ public:
 	UPROPERTY(EditAnywhere)
 	UParticleSystemComponent* Sparks = nullptr;
 
-	UPROPERTY(VisibleAnywhere, Replicated)
+	/** Written by the game state lamp table on the server */
+	UPROPERTY(VisibleAnywhere, ReplicatedUsing = OnRep_LightColor)
 	FLinearColor LightColor;
 
-	virtual void Use() override;
+	UFUNCTION()
+	void OnRep_LightColor();
 
-	UFUNCTION(NetMulticast, Reliable, WithValidation)
-	void MulticastUse();
+	void SetLightColor(const FLinearColor& Color);
 
-	UFUNCTION(NetMulticast, Reliable, WithValidation)
-	void MulticastSetState(bool State);
+	/** Light on and sparks off, or the other way round */
+	UPROPERTY(VisibleAnywhere, ReplicatedUsing = OnRep_LightOn)
+	bool bLightOn = true;
 
 	UFUNCTION()
-	void TurnOff();
+	void OnRep_LightOn();
 
+	virtual void Use() override;
+
+	/** Server only, clients follow bLightOn */
 	UFUNCTION()
-	void SetState(bool State);
+	void TurnOff();
 
 	UFUNCTION()
-	void ToggleVisibility();
+	void SetState(bool State);
 
+private:
+	void UpdateLightState();
 };
@@ -0,0 +1,198 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "EffectPoolComponent.h"
+#include "Futurum.h"
+#include "FrameArena.h"
+#include "Components/AudioComponent.h"
+#include "Particles/ParticleSystem.h"
+#include "Particles/ParticleSystemComponent.h"
+#include "Sound/SoundBase.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+
+DECLARE_CYCLE_STAT(TEXT("Effect pool flush"), STAT_EffectPoolFlush, STATGROUP_Futurum);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Effects played"), STAT_EffectsPlayed, STATGROUP_Futurum);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Effects merged"), STAT_EffectsMerged, STATGROUP_Futurum);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Effects culled"), STAT_EffectsCulled, STATGROUP_Futurum);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Effects over cap"), STAT_EffectsOverCap, STATGROUP_Futurum);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pooled effect components"), STAT_PooledEffectComponents, STATGROUP_Futurum);
+
+UEffectPoolComponent::UEffectPoolComponent()
+{
+	PrimaryComponentTick.bCanEverTick = true;
+	// Effects asked for by anything that ticked this frame get played in this frame
+	PrimaryComponentTick.TickGroup = TG_PostUpdateWork;
+}
+
+void UEffectPoolComponent::SpawnEffect(UParticleSystem* Particles, USoundBase* Sound, const FVector& Location, float VolumeMultiplier)
+{
+	if (GetNetMode() == NM_DedicatedServer)
+	{
+		return;
+	}
+
+	FEffectRequest Request;
+	Request.Particles = Particles;
+	Request.Sound = Sound;
+	Request.Location = Location;
+	Request.VolumeMultiplier = VolumeMultiplier;
+	PendingEffects.Add(Request);
+}
+
+void UEffectPoolComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	FFrameAllocationScope AllocationScope;
+	AllocationScope.Watch(PendingEffects);
+	if (PendingEffects.Num() == 0)
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_EffectPoolFlush);
+
+	FVector ViewLocation;
+	FRotator ViewRotation;
+	APlayerController* PlayerController = GetWorld()->GetFirstPlayerController();
+	const bool bHasView = PlayerController != nullptr;
+	if (bHasView)
+	{
+		PlayerController->GetPlayerViewPoint(ViewLocation, ViewRotation);
+	}
+
+	for (int32 Index = 0; Index < PendingEffects.Num(); ++Index)
+	{
+		const FEffectRequest& Request = PendingEffects[Index];
+		if (bHasView && FVector::DistSquared(Request.Location, ViewLocation) > FMath::Square(CullDistance))
+		{
+			INC_DWORD_STAT(STAT_EffectsCulled);
+			continue;
+		}
+
+		bool bMerged = false;
+		for (int32 OtherIndex = 0; OtherIndex < Index && !bMerged; ++OtherIndex)
+		{
+			const FEffectRequest& Other = PendingEffects[OtherIndex];
+			bMerged = Other.Particles == Request.Particles && Other.Sound == Request.Sound
+				&& FVector::DistSquared(Other.Location, Request.Location) < FMath::Square(MergeDistance);
+		}
+		if (bMerged)
+		{
+			INC_DWORD_STAT(STAT_EffectsMerged);
+			continue;
+		}
+
+		if (Request.Particles)
+		{
+			PlayParticles(Request.Particles, Request.Location);
+		}
+		if (Request.Sound)
+		{
+			PlaySound(Request.Sound, Request.Location, Request.VolumeMultiplier);
+		}
+	}
+	PendingEffects.Reset();
+}
+
+void UEffectPoolComponent::PlayParticles(UParticleSystem* Particles, const FVector& Location)
+{
+	UParticleSystemComponent* FreeComponent = nullptr;
+	int32 Playing = 0;
+	for (UParticleSystemComponent* Component : ParticleComponents)
+	{
+		if (Component->Template == Particles)
+		{
+			if (Component->IsActive())
+			{
+				++Playing;
+			}
+			else if (!FreeComponent)
+			{
+				FreeComponent = Component;
+			}
+		}
+	}
+
+	if (!FreeComponent)
+	{
+		if (Playing >= MaxParticlesPerTemplate)
+		{
+			INC_DWORD_STAT(STAT_EffectsOverCap);
+			return;
+		}
+
+		FreeComponent = NewObject<UParticleSystemComponent>(GetOwner());
+		FreeComponent->bAutoActivate = false;
+		FreeComponent->bAutoDestroy = false;
+		FreeComponent->SetAbsolute(true, true, true);
+		FreeComponent->SetTemplate(Particles);
+		FreeComponent->RegisterComponentWithWorld(GetWorld());
+		ParticleComponents.Add(FreeComponent);
+		INC_DWORD_STAT(STAT_PooledEffectComponents);
+	}
+
+	FreeComponent->SetWorldLocation(Location);
+	FreeComponent->ActivateSystem(true);
+	INC_DWORD_STAT(STAT_EffectsPlayed);
+}
+
+void UEffectPoolComponent::PlaySound(USoundBase* Sound, const FVector& Location, float VolumeMultiplier)
+{
+	UAudioComponent* FreeComponent = nullptr;
+	int32 Playing = 0;
+	for (UAudioComponent* Component : AudioComponents)
+	{
+		if (Component->Sound == Sound)
+		{
+			if (Component->IsPlaying())
+			{
+				++Playing;
+			}
+			else if (!FreeComponent)
+			{
+				FreeComponent = Component;
+			}
+		}
+	}
+
+	if (!FreeComponent)
+	{
+		if (Playing >= MaxSoundsPerTemplate)
+		{
+			INC_DWORD_STAT(STAT_EffectsOverCap);
+			return;
+		}
+
+		FreeComponent = NewObject<UAudioComponent>(GetOwner());
+		FreeComponent->bAutoActivate = false;
+		FreeComponent->bAutoDestroy = false;
+		FreeComponent->bAllowSpatialization = true;
+		FreeComponent->SetSound(Sound);
+		FreeComponent->RegisterComponentWithWorld(GetWorld());
+		AudioComponents.Add(FreeComponent);
+		INC_DWORD_STAT(STAT_PooledEffectComponents);
+	}
+
+	FreeComponent->SetWorldLocation(Location);
+	FreeComponent->SetVolumeMultiplier(VolumeMultiplier);
+	FreeComponent->Play();
+}
+
+void UEffectPoolComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	for (UParticleSystemComponent* Component : ParticleComponents)
+	{
+		Component->DestroyComponent();
+	}
+	for (UAudioComponent* Component : AudioComponents)
+	{
+		Component->DestroyComponent();
+	}
+	DEC_DWORD_STAT_BY(STAT_PooledEffectComponents, ParticleComponents.Num() + AudioComponents.Num());
+	ParticleComponents.Reset();
+	AudioComponents.Reset();
+	PendingEffects.Reset();
+
+	Super::EndPlay(EndPlayReason);
+}
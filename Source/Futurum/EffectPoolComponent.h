@@ -0,0 +1,68 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "EffectPoolComponent.generated.h"
+
+class UParticleSystem;
+class UParticleSystemComponent;
+class USoundBase;
+class UAudioComponent;
+
+/**
+ * Plays one shot explosions out of a pool of particle and audio components.
+ * Effects asked for during a frame are played together at the end of it: the ones far from
+ * the local view are dropped, the ones landing on top of each other are played once, and
+ * every template has a cap on how many play at a time. Nothing is played on a dedicated server.
+ */
+UCLASS()
+class FUTURUM_API UEffectPoolComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	UEffectPoolComponent();
+
+	void SpawnEffect(UParticleSystem* Particles, USoundBase* Sound, const FVector& Location, float VolumeMultiplier = 1.f);
+
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	/** Effects of the same kind closer than this in one frame are played once */
+	UPROPERTY(EditAnywhere, Category = Effects)
+	float MergeDistance = 150.f;
+
+	/** Effects further than this from the local view are not played */
+	UPROPERTY(EditAnywhere, Category = Effects)
+	float CullDistance = 15000.f;
+
+	UPROPERTY(EditAnywhere, Category = Effects)
+	int32 MaxParticlesPerTemplate = 12;
+
+	UPROPERTY(EditAnywhere, Category = Effects)
+	int32 MaxSoundsPerTemplate = 6;
+
+private:
+	struct FEffectRequest
+	{
+		UParticleSystem* Particles;
+		USoundBase* Sound;
+		FVector Location;
+		float VolumeMultiplier;
+	};
+
+	void PlayParticles(UParticleSystem* Particles, const FVector& Location);
+
+	void PlaySound(USoundBase* Sound, const FVector& Location, float VolumeMultiplier);
+
+	TArray<FEffectRequest> PendingEffects;
+
+	UPROPERTY(Transient)
+	TArray<UParticleSystemComponent*> ParticleComponents;
+
+	UPROPERTY(Transient)
+	TArray<UAudioComponent*> AudioComponents;
+};
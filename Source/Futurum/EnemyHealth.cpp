@@ -0,0 +1,246 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "EnemyHealth.h"
+#include "Futurum.h"
+#include "BallEnemy.h"
+#include "NetMetrics.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/CoreNet.h"
+
+DECLARE_CYCLE_STAT(TEXT("Enemy health flush"), STAT_EnemyHealthFlush, STATGROUP_Futurum);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Enemy health changes"), STAT_EnemyHealthChanges, STATGROUP_Futurum);
+
+const float FEnemyHealthStore::DamagedHealth = 40.f;
+
+namespace
+{
+	/** Writes the changed fast array entries the way the replication layout of a struct does, field by field */
+	class FEnemyHealthSerializeCB : public INetSerializeCB
+	{
+	public:
+		virtual void NetSerializeStruct(UScriptStruct* Struct, FBitArchive& Ar, UPackageMap* Map, void* Data, bool& bHasUnmapped) override
+		{
+			FNetMetrics::SerializeStruct(Ar, Struct, Data, nullptr);
+		}
+	};
+
+	/** Bits of a health change sent as a float property on the enemy's own channel, the bunch header left out */
+	int64 GetActorPropertyUpdateBits(float Health)
+	{
+		FNetBitWriter Payload(nullptr, 64);
+		uint32 Handle = 1;
+		Payload.SerializeIntPacked(Handle);
+		Payload << Health;
+		uint32 EndHandle = 0;
+		Payload.SerializeIntPacked(EndHandle);
+
+		// Content block header: replicated layout and the actor itself, then the payload size
+		FNetBitWriter Header(nullptr, 64);
+		Header.WriteBit(1);
+		Header.WriteBit(1);
+		uint32 PayloadBits = Payload.GetNumBits();
+		Header.SerializeIntPacked(PayloadBits);
+
+		return Header.GetNumBits() + Payload.GetNumBits();
+	}
+
+	void BenchmarkEnemyHealth(const TArray<FString>& Args)
+	{
+		const int32 NumEnemies = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 1000;
+		const int32 Frames = 600;
+		const int32 HitsPerFrame = FMath::Max(NumEnemies / 10, 1);
+
+		FEnemyHealthStore Store;
+		FEnemyHealthArray Replicated;
+		for (int32 Index = 0; Index < NumEnemies; ++Index)
+		{
+			Store.Add(nullptr, 100.f, Replicated);
+		}
+
+		// One connection acking every update, each delta is against the previous frame
+		FEnemyHealthSerializeCB SerializeCB;
+		TSharedPtr<INetDeltaBaseState> AckedState;
+		auto SerializeDelta = [&Replicated, &SerializeCB, &AckedState]()
+		{
+			FNetBitWriter Writer(nullptr, 1024);
+			TSharedPtr<INetDeltaBaseState> NewState;
+			FNetDeltaSerializeInfo Parms;
+			Parms.Writer = &Writer;
+			Parms.OldState = AckedState.Get();
+			Parms.NewState = &NewState;
+			Parms.NetSerializeCB = &SerializeCB;
+			if (Replicated.NetDeltaSerialize(Parms))
+			{
+				AckedState = NewState;
+			}
+			return (int64)Writer.GetNumBits();
+		};
+
+		// The initial full send is what a joining client pays, not the steady rate
+		const int64 InitialBits = SerializeDelta();
+
+		FRandomStream Random(NumEnemies);
+		TFrameArray<FEnemyHealthStore::FEvent> Events;
+		TFrameArray<int32> Changed;
+		int32 TotalChanged = 0;
+		int32 TotalEvents = 0;
+		int64 FastArrayBits = 0;
+		int64 ActorPropertyBits = 0;
+		double FlushTime = 0.0;
+		for (int32 Frame = 0; Frame < Frames; ++Frame)
+		{
+			for (int32 Hit = 0; Hit < HitsPerFrame; ++Hit)
+			{
+				const int32 Id = Random.RandHelper(NumEnemies);
+				Store.ApplyDamage(Id, 10.f);
+			}
+
+			Events.Reset();
+			Changed.Reset();
+			const double Start = FPlatformTime::Seconds();
+			Store.Flush(Replicated, Events, Changed);
+			FlushTime += FPlatformTime::Seconds() - Start;
+			TotalChanged += Changed.Num();
+			TotalEvents += Events.Num();
+
+			FastArrayBits += SerializeDelta();
+			for (int32 Id : Changed)
+			{
+				ActorPropertyBits += GetActorPropertyUpdateBits(Store.GetHealth(Id));
+			}
+
+			// Dead ones come back so the load stays the same
+			for (const FEnemyHealthStore::FEvent& Event : Events)
+			{
+				if (Event.Type == EEnemyHealthEvent::Destroyed)
+				{
+					Store.SetHealth(Event.Id, 100.f);
+				}
+			}
+		}
+
+		const float Seconds = Frames / 60.f;
+		UE_LOG(LogFuturum, Log, TEXT("Enemy health, %d enemies, %d hits per frame: %.4f ms per flush, %d changes, %d threshold events"),
+			NumEnemies, HitsPerFrame, FlushTime * 1000.0 / Frames, TotalChanged, TotalEvents);
+		UE_LOG(LogFuturum, Log, TEXT("Enemy health at 60 Hz per connection: fast array %.0f bytes/s (%lld bytes initial), per actor properties %.0f bytes/s before bunch headers"),
+			FastArrayBits / 8.0 / Seconds, (InitialBits + 7) / 8, ActorPropertyBits / 8.0 / Seconds);
+	}
+}
+
+static FAutoConsoleCommand BenchmarkEnemyHealthCommand(
+	TEXT("Futurum.BenchEnemyHealth"),
+	TEXT("Runs 10 s of random hits on a health table and logs the flush time and the serialized bandwidth. Takes the number of enemies, 1000 by default."),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkEnemyHealth));
+
+void FEnemyHealthItem::PostReplicatedAdd(const FEnemyHealthArray& InArraySerializer)
+{
+	PostReplicatedChange(InArraySerializer);
+}
+
+void FEnemyHealthItem::PostReplicatedChange(const FEnemyHealthArray& InArraySerializer)
+{
+	// Null until the enemy itself replicates, which then reads its entry
+	if (Enemy)
+	{
+		Enemy->OnHealthChanged(Health);
+	}
+}
+
+int32 FEnemyHealthStore::Add(ABallEnemy* Enemy, float NewHealth, FEnemyHealthArray& Replicated)
+{
+	Health.Add(NewHealth);
+	PendingDamage.Add(0.f);
+	Queued.Add(false);
+	Enemies.Add(Enemy);
+
+	FEnemyHealthItem& Item = Replicated.Items[Replicated.Items.AddDefaulted()];
+	Item.Enemy = Enemy;
+	Item.Health = NewHealth;
+	Replicated.MarkItemDirty(Item);
+
+	return Health.Num() - 1;
+}
+
+void FEnemyHealthStore::Remove(int32 Id, FEnemyHealthArray& Replicated)
+{
+	const int32 Last = Health.Num() - 1;
+	if (Queued[Id])
+	{
+		Dirty.RemoveSwap(Id);
+	}
+
+	// The last enemy takes the removed one's id
+	if (Id != Last)
+	{
+		if (Queued[Last])
+		{
+			Dirty[Dirty.Find(Last)] = Id;
+		}
+		if (Enemies[Last])
+		{
+			Enemies[Last]->HealthId = Id;
+		}
+	}
+
+	Health.RemoveAtSwap(Id, 1, false);
+	PendingDamage.RemoveAtSwap(Id, 1, false);
+	Queued.RemoveAtSwap(Id, 1, false);
+	Enemies.RemoveAtSwap(Id, 1, false);
+	Replicated.Items.RemoveAtSwap(Id, 1, false);
+	Replicated.MarkArrayDirty();
+}
+
+void FEnemyHealthStore::Reset(FEnemyHealthArray& Replicated)
+{
+	Health.Reset();
+	PendingDamage.Reset();
+	Queued.Reset();
+	Enemies.Reset();
+	Dirty.Reset();
+	Replicated.Items.Reset();
+	Replicated.MarkArrayDirty();
+}
+
+void FEnemyHealthStore::SetHealth(int32 Id, float NewHealth)
+{
+	// Flushed as a change of health with no damage, so without events
+	Queue(Id);
+	PendingDamage[Id] = 0.f;
+	Health[Id] = NewHealth;
+}
+
+void FEnemyHealthStore::Flush(FEnemyHealthArray& Replicated, TFrameArray<FEvent>& OutEvents, TFrameArray<int32>& OutChanged)
+{
+	SCOPE_CYCLE_COUNTER(STAT_EnemyHealthFlush);
+
+	for (int32 Id : Dirty)
+	{
+		const float OldHealth = Replicated.Items[Id].Health;
+		const bool bDamaged = PendingDamage[Id] > 0.f;
+		const float NewHealth = FMath::Max(Health[Id] - PendingDamage[Id], 0.f);
+		PendingDamage[Id] = 0.f;
+		Queued[Id] = false;
+		Health[Id] = NewHealth;
+		if (NewHealth == OldHealth)
+		{
+			continue;
+		}
+
+		// Thresholds are only crossed by damage, set health moves silently
+		if (bDamaged && NewHealth <= 0.f && OldHealth > 0.f)
+		{
+			OutEvents.Add({ Id, EEnemyHealthEvent::Destroyed });
+		}
+		else if (bDamaged && NewHealth <= DamagedHealth && OldHealth > DamagedHealth)
+		{
+			OutEvents.Add({ Id, EEnemyHealthEvent::Damaged });
+		}
+
+		FEnemyHealthItem& Item = Replicated.Items[Id];
+		Item.Health = NewHealth;
+		Replicated.MarkItemDirty(Item);
+		OutChanged.Add(Id);
+	}
+	INC_DWORD_STAT_BY(STAT_EnemyHealthChanges, OutChanged.Num());
+	Dirty.Reset();
+}
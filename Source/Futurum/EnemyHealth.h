@@ -0,0 +1,122 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/NetSerialization.h"
+#include "FrameArena.h"
+#include "EnemyHealth.generated.h"
+
+class ABallEnemy;
+struct FEnemyHealthArray;
+
+/** Health of one enemy as the clients see it */
+USTRUCT()
+struct FEnemyHealthItem : public FFastArraySerializerItem
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	ABallEnemy* Enemy = nullptr;
+
+	UPROPERTY()
+	float Health = 0.f;
+
+	void PostReplicatedAdd(const FEnemyHealthArray& InArraySerializer);
+
+	void PostReplicatedChange(const FEnemyHealthArray& InArraySerializer);
+};
+
+/** Health of every enemy, each connection only receives the entries changed since its last update */
+USTRUCT()
+struct FEnemyHealthArray : public FFastArraySerializer
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<FEnemyHealthItem> Items;
+
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+	{
+		return FFastArraySerializer::FastArrayDeltaSerialize<FEnemyHealthItem, FEnemyHealthArray>(Items, DeltaParms, *this);
+	}
+};
+
+template<>
+struct TStructOpsTypeTraits<FEnemyHealthArray> : public TStructOpsTypeTraitsBase2<FEnemyHealthArray>
+{
+	enum
+	{
+		WithNetDeltaSerializer = true
+	};
+};
+
+enum class EEnemyHealthEvent : uint8
+{
+	/** Went under DamagedHealth */
+	Damaged,
+
+	/** Went to 0 */
+	Destroyed
+};
+
+/**
+ * Authoritative health of every enemy, one array per field indexed by enemy id. Damage is
+ * gathered during the frame and applied in one pass, which reports the enemies crossing a
+ * threshold and mirrors every changed entry into the replicated array. Server only.
+ */
+class FUTURUM_API FEnemyHealthStore
+{
+public:
+	/** Health under which an enemy shows sparks */
+	static const float DamagedHealth;
+
+	struct FEvent
+	{
+		int32 Id;
+		EEnemyHealthEvent Type;
+	};
+
+	/** Returns the id of the enemy, the ids of the other enemies may change when one is removed */
+	int32 Add(ABallEnemy* Enemy, float Health, FEnemyHealthArray& Replicated);
+
+	void Remove(int32 Id, FEnemyHealthArray& Replicated);
+
+	void Reset(FEnemyHealthArray& Replicated);
+
+	FORCEINLINE void ApplyDamage(int32 Id, float Damage)
+	{
+		Queue(Id);
+		PendingDamage[Id] += Damage;
+	}
+
+	/** Sets the health without raising events, for restarts and replays */
+	void SetHealth(int32 Id, float NewHealth);
+
+	/** Applies the damage of the frame. OutChanged gets the ids whose health changed */
+	void Flush(FEnemyHealthArray& Replicated, TFrameArray<FEvent>& OutEvents, TFrameArray<int32>& OutChanged);
+
+	FORCEINLINE float GetHealth(int32 Id) const { return Health[Id]; }
+
+	FORCEINLINE ABallEnemy* GetEnemy(int32 Id) const { return Enemies[Id]; }
+
+	FORCEINLINE int32 Num() const { return Health.Num(); }
+
+private:
+	FORCEINLINE void Queue(int32 Id)
+	{
+		if (!Queued[Id])
+		{
+			Queued[Id] = true;
+			Dirty.Add(Id);
+		}
+	}
+
+	TArray<float> Health;
+	TArray<float> PendingDamage;
+	TArray<uint8> Queued;
+	TArray<ABallEnemy*> Enemies;
+
+	/** Ids damaged or set since the last flush */
+	TArray<int32> Dirty;
+};
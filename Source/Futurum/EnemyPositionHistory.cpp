@@ -0,0 +1,74 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "EnemyPositionHistory.h"
+
+
+FEnemyPositionHistory::FEnemyPositionHistory()
+{
+	Reset();
+}
+
+void FEnemyPositionHistory::Reset()
+{
+	Head = 0;
+	Count = 0;
+}
+
+void FEnemyPositionHistory::Record(float Time, const FVector& Location)
+{
+	int32 Slot = Head;
+	if (Count > 0)
+	{
+		const int32 Newest = (Head + NumSamples - 1) % NumSamples;
+		if (Time <= Times[Newest])
+		{
+			Slot = Newest;
+		}
+	}
+
+	Times[Slot] = Time;
+	X[Slot] = Location.X;
+	Y[Slot] = Location.Y;
+	Z[Slot] = Location.Z;
+
+	if (Slot == Head)
+	{
+		Head = (Head + 1) % NumSamples;
+		Count = FMath::Min(Count + 1, NumSamples);
+	}
+}
+
+bool FEnemyPositionHistory::GetLocationAt(float Time, FVector& OutLocation) const
+{
+	if (Count == 0)
+	{
+		return false;
+	}
+
+	int32 Newer = (Head + NumSamples - 1) % NumSamples;
+	if (Time < Times[Newer])
+	{
+		for (int32 Step = 1; Step < Count; ++Step)
+		{
+			const int32 Older = (Head + NumSamples - 1 - Step) % NumSamples;
+			if (Times[Older] <= Time)
+			{
+				const float Alpha = (Time - Times[Older]) / (Times[Newer] - Times[Older]);
+				OutLocation = FVector(
+					FMath::Lerp(X[Older], X[Newer], Alpha),
+					FMath::Lerp(Y[Older], Y[Newer], Alpha),
+					FMath::Lerp(Z[Older], Z[Newer], Alpha));
+				return true;
+			}
+			Newer = Older;
+		}
+	}
+
+	OutLocation = FVector(X[Newer], Y[Newer], Z[Newer]);
+	return true;
+}
+
+float FEnemyPositionHistory::GetOldestTime() const
+{
+	return Count > 0 ? Times[(Head + NumSamples - Count) % NumSamples] : 0.f;
+}
@@ -0,0 +1,38 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Fixed size ring buffer of the recent locations of one enemy, sampled every server tick.
+ * Timestamps and coordinates live in separate arrays so a rewind query only walks the
+ * timestamps until it finds its slot. Enemies are spheres, so no rotation is kept.
+ */
+struct FUTURUM_API FEnemyPositionHistory
+{
+	static const int32 NumSamples = 32;
+
+	FEnemyPositionHistory();
+
+	void Reset();
+
+	/** Adds a sample, a second sample in the same tick replaces the first one. */
+	void Record(float Time, const FVector& Location);
+
+	/** Location at Time, interpolated between samples and clamped to the recorded range. */
+	bool GetLocationAt(float Time, FVector& OutLocation) const;
+
+	/** Time of the oldest sample still in the buffer */
+	float GetOldestTime() const;
+
+private:
+	float Times[NumSamples];
+	float X[NumSamples];
+	float Y[NumSamples];
+	float Z[NumSamples];
+
+	/** Slot the next sample goes to */
+	int32 Head;
+	int32 Count;
+};
@@ -0,0 +1,239 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "EnemySteering.h"
+#include "Futurum.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Enemy steering grid"), STAT_EnemySteeringGrid, STATGROUP_Futurum);
+DECLARE_CYCLE_STAT(TEXT("Enemy steering pass"), STAT_EnemySteeringPass, STATGROUP_Futurum);
+
+namespace
+{
+	void BenchmarkSteering(const TArray<FString>& Args)
+	{
+		const int32 Updates = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 10;
+		for (int32 NumAgents : { 1000, 10000 })
+		{
+			for (bool bSingleThread : { true, false })
+			{
+				FEnemySteering Steering;
+				Steering.Settings.bForceSingleThread = bSingleThread;
+				FRandomStream Random(NumAgents);
+				const FBox& Arena = Steering.Settings.Arena;
+
+				double Time = 0.0;
+				for (int32 Update = 0; Update < Updates; ++Update)
+				{
+					Steering.Reset(NumAgents);
+					for (int32 Index = 0; Index < NumAgents; ++Index)
+					{
+						Steering.SetAgent(Index, Random.RandPointInBox(Arena), Random.GetUnitVector() * 600.f);
+					}
+					Steering.AddTarget(Arena.GetCenter());
+
+					const double Start = FPlatformTime::Seconds();
+					Steering.Update(1.f / 30.f);
+					Time += FPlatformTime::Seconds() - Start;
+				}
+
+				UE_LOG(LogFuturum, Log, TEXT("Steering %d agents, %s: %.3f ms per update"),
+					NumAgents, bSingleThread ? TEXT("single thread") : TEXT("parallel"), Time * 1000.0 / FMath::Max(Updates, 1));
+			}
+		}
+	}
+}
+
+static FAutoConsoleCommand BenchmarkSteeringCommand(
+	TEXT("Futurum.BenchSteering"),
+	TEXT("Times the enemy steering pass on 1k and 10k random agents, single threaded and parallel. Takes the number of updates."),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkSteering));
+
+void FEnemySteering::Reset(int32 NumAgents)
+{
+	LocationX.SetNumUninitialized(NumAgents, false);
+	LocationY.SetNumUninitialized(NumAgents, false);
+	LocationZ.SetNumUninitialized(NumAgents, false);
+	VelocityX.SetNumUninitialized(NumAgents, false);
+	VelocityY.SetNumUninitialized(NumAgents, false);
+	VelocityZ.SetNumUninitialized(NumAgents, false);
+	Targets.Reset();
+}
+
+SIZE_T FEnemySteering::GetAllocatedSize() const
+{
+	return LocationX.GetAllocatedSize() + LocationY.GetAllocatedSize() + LocationZ.GetAllocatedSize()
+		+ VelocityX.GetAllocatedSize() + VelocityY.GetAllocatedSize() + VelocityZ.GetAllocatedSize()
+		+ NewVelocityX.GetAllocatedSize() + NewVelocityY.GetAllocatedSize() + NewVelocityZ.GetAllocatedSize()
+		+ Targets.GetAllocatedSize() + SortedAgents.GetAllocatedSize() + BucketStart.GetAllocatedSize() + AgentBucket.GetAllocatedSize();
+}
+
+void FEnemySteering::SetAgent(int32 Index, const FVector& Location, const FVector& Velocity)
+{
+	LocationX[Index] = Location.X;
+	LocationY[Index] = Location.Y;
+	LocationZ[Index] = Location.Z;
+	VelocityX[Index] = Velocity.X;
+	VelocityY[Index] = Velocity.Y;
+	VelocityZ[Index] = Velocity.Z;
+}
+
+void FEnemySteering::AddTarget(const FVector& Location)
+{
+	Targets.Add(Location);
+}
+
+void FEnemySteering::Update(float DeltaTime)
+{
+	const int32 NumAgents = Num();
+	if (NumAgents == 0)
+	{
+		return;
+	}
+
+	BuildGrid();
+
+	SCOPE_CYCLE_COUNTER(STAT_EnemySteeringPass);
+
+	NewVelocityX.SetNumUninitialized(NumAgents, false);
+	NewVelocityY.SetNumUninitialized(NumAgents, false);
+	NewVelocityZ.SetNumUninitialized(NumAgents, false);
+
+	const int32 ChunkSize = FMath::Max(Settings.ChunkSize, 1);
+	const int32 NumChunks = FMath::DivideAndRoundUp(NumAgents, ChunkSize);
+	ParallelFor(NumChunks, [this, DeltaTime, NumAgents, ChunkSize](int32 Chunk)
+	{
+		const int32 End = FMath::Min((Chunk + 1) * ChunkSize, NumAgents);
+		for (int32 Index = Chunk * ChunkSize; Index < End; ++Index)
+		{
+			const FVector Velocity = Steer(Index, DeltaTime);
+			NewVelocityX[Index] = Velocity.X;
+			NewVelocityY[Index] = Velocity.Y;
+			NewVelocityZ[Index] = Velocity.Z;
+		}
+	}, Settings.bForceSingleThread || NumChunks == 1);
+
+	Swap(VelocityX, NewVelocityX);
+	Swap(VelocityY, NewVelocityY);
+	Swap(VelocityZ, NewVelocityZ);
+}
+
+void FEnemySteering::BuildGrid()
+{
+	SCOPE_CYCLE_COUNTER(STAT_EnemySteeringGrid);
+
+	// Twice as many buckets as agents keeps collisions rare, plus one entry to close the last bucket
+	const int32 NumAgents = Num();
+	const int32 NumBuckets = FMath::RoundUpToPowerOfTwo(FMath::Max(NumAgents * 2, 64));
+	BucketStart.Reset();
+	BucketStart.AddZeroed(NumBuckets + 1);
+	AgentBucket.SetNumUninitialized(NumAgents, false);
+	SortedAgents.SetNumUninitialized(NumAgents, false);
+
+	for (int32 Index = 0; Index < NumAgents; ++Index)
+	{
+		const int32 Bucket = GetBucket(GetCell(LocationX[Index], LocationY[Index], LocationZ[Index]));
+		AgentBucket[Index] = Bucket;
+		++BucketStart[Bucket + 1];
+	}
+	for (int32 Bucket = 0; Bucket < NumBuckets; ++Bucket)
+	{
+		BucketStart[Bucket + 1] += BucketStart[Bucket];
+	}
+
+	// Counting sort, BucketStart is moved forward while filling and restored after
+	for (int32 Index = 0; Index < NumAgents; ++Index)
+	{
+		SortedAgents[BucketStart[AgentBucket[Index]]++] = Index;
+	}
+	for (int32 Bucket = NumBuckets; Bucket > 0; --Bucket)
+	{
+		BucketStart[Bucket] = BucketStart[Bucket - 1];
+	}
+	BucketStart[0] = 0;
+}
+
+FVector FEnemySteering::Steer(int32 Index, float DeltaTime) const
+{
+	const FVector Location(LocationX[Index], LocationY[Index], LocationZ[Index]);
+	const FVector Velocity(VelocityX[Index], VelocityY[Index], VelocityZ[Index]);
+	FVector Acceleration = FVector::ZeroVector;
+
+	// Seek the closest target at full speed
+	if (Targets.Num() > 0)
+	{
+		FVector Target = Targets[0];
+		for (int32 TargetIndex = 1; TargetIndex < Targets.Num(); ++TargetIndex)
+		{
+			if (FVector::DistSquared(Targets[TargetIndex], Location) < FVector::DistSquared(Target, Location))
+			{
+				Target = Targets[TargetIndex];
+			}
+		}
+		const FVector DesiredVelocity = (Target - Location).GetSafeNormal() * Settings.MaxSpeed;
+		Acceleration += (DesiredVelocity - Velocity).GetClampedToMaxSize(Settings.MaxAcceleration) * Settings.SeekWeight;
+	}
+
+	// Separation from the agents of the surrounding cells
+	const float RadiusSquared = FMath::Square(Settings.NeighborRadius);
+	const FIntVector Cell = GetCell(Location.X, Location.Y, Location.Z);
+	FVector Separation = FVector::ZeroVector;
+	int32 Visited[27];
+	int32 NumVisited = 0;
+	for (int32 X = -1; X <= 1; ++X)
+	{
+		for (int32 Y = -1; Y <= 1; ++Y)
+		{
+			for (int32 Z = -1; Z <= 1; ++Z)
+			{
+				// Neighboring cells may hash to the same bucket, walk each bucket once
+				const int32 Bucket = GetBucket(Cell + FIntVector(X, Y, Z));
+				bool bVisited = false;
+				for (int32 VisitedIndex = 0; VisitedIndex < NumVisited && !bVisited; ++VisitedIndex)
+				{
+					bVisited = Visited[VisitedIndex] == Bucket;
+				}
+				if (bVisited)
+				{
+					continue;
+				}
+				Visited[NumVisited++] = Bucket;
+
+				for (int32 Sorted = BucketStart[Bucket]; Sorted < BucketStart[Bucket + 1]; ++Sorted)
+				{
+					const int32 Other = SortedAgents[Sorted];
+					const FVector Offset(Location.X - LocationX[Other], Location.Y - LocationY[Other], Location.Z - LocationZ[Other]);
+					const float DistanceSquared = Offset.SizeSquared();
+					if (Other != Index && DistanceSquared < RadiusSquared && DistanceSquared > KINDA_SMALL_NUMBER)
+					{
+						// Stronger the closer the neighbor is
+						const float Distance = FMath::Sqrt(DistanceSquared);
+						Separation += Offset / Distance * (1.f - Distance / Settings.NeighborRadius);
+					}
+				}
+			}
+		}
+	}
+	Acceleration += Separation.GetClampedToMaxSize(1.f) * Settings.MaxAcceleration * Settings.SeparationWeight;
+
+	// Turn back before reaching the sides of the arena
+	const FBox& Arena = Settings.Arena;
+	const float Margin = FMath::Max(Settings.WallMargin, 1.f);
+	FVector Wall = FVector::ZeroVector;
+	for (int32 Axis = 0; Axis < 3; ++Axis)
+	{
+		const float ToMin = Location[Axis] - Arena.Min[Axis];
+		const float ToMax = Arena.Max[Axis] - Location[Axis];
+		if (ToMin < Margin)
+		{
+			Wall[Axis] += 1.f - FMath::Max(ToMin, 0.f) / Margin;
+		}
+		if (ToMax < Margin)
+		{
+			Wall[Axis] -= 1.f - FMath::Max(ToMax, 0.f) / Margin;
+		}
+	}
+	Acceleration += Wall * Settings.MaxAcceleration * Settings.WallWeight;
+
+	return (Velocity + Acceleration * DeltaTime).GetClampedToMaxSize(Settings.MaxSpeed);
+}
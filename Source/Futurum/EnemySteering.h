@@ -0,0 +1,90 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FEnemySteeringSettings
+{
+	/** Agents closer than this push each other apart, also the size of a grid cell */
+	float NeighborRadius = 300.f;
+
+	float SeekWeight = 1.f;
+	float SeparationWeight = 2.f;
+	float WallWeight = 3.f;
+
+	float MaxSpeed = 1200.f;
+	float MaxAcceleration = 1500.f;
+
+	/** Space the agents are kept in, they start turning back WallMargin away from its sides */
+	FBox Arena = FBox(FVector(-1500.f, -1500.f, 100.f), FVector(1500.f, 1500.f, 1000.f));
+	float WallMargin = 300.f;
+
+	/** Agents handled by one task */
+	int32 ChunkSize = 256;
+
+	bool bForceSingleThread = false;
+};
+
+/**
+ * Seek, separation and wall avoidance for every enemy in one pass. Agents are stored one array
+ * per component, neighbors are found through a hashed uniform grid rebuilt every update, and the
+ * steering pass runs over chunks of agents on the task graph.
+ */
+class FUTURUM_API FEnemySteering
+{
+public:
+	FEnemySteeringSettings Settings;
+
+	/** Starts a new update with NumAgents agents and no targets */
+	void Reset(int32 NumAgents);
+
+	void SetAgent(int32 Index, const FVector& Location, const FVector& Velocity);
+
+	/** Agents seek the closest target */
+	void AddTarget(const FVector& Location);
+
+	void Update(float DeltaTime);
+
+	FORCEINLINE int32 Num() const { return LocationX.Num(); }
+
+	/** Memory of the agent arrays and the grid, kept between updates */
+	SIZE_T GetAllocatedSize() const;
+
+	FORCEINLINE FVector GetVelocity(int32 Index) const { return FVector(VelocityX[Index], VelocityY[Index], VelocityZ[Index]); }
+
+private:
+	void BuildGrid();
+
+	FORCEINLINE FIntVector GetCell(float X, float Y, float Z) const
+	{
+		const float InvCellSize = 1.f / Settings.NeighborRadius;
+		return FIntVector(FMath::FloorToInt(X * InvCellSize), FMath::FloorToInt(Y * InvCellSize), FMath::FloorToInt(Z * InvCellSize));
+	}
+
+	FORCEINLINE int32 GetBucket(const FIntVector& Cell) const
+	{
+		return ((uint32)Cell.X * 73856093u ^ (uint32)Cell.Y * 19349663u ^ (uint32)Cell.Z * 83492791u) & (uint32)(BucketStart.Num() - 2);
+	}
+
+	FVector Steer(int32 Index, float DeltaTime) const;
+
+	TArray<float> LocationX;
+	TArray<float> LocationY;
+	TArray<float> LocationZ;
+	TArray<float> VelocityX;
+	TArray<float> VelocityY;
+	TArray<float> VelocityZ;
+
+	/** Velocities written by the steering pass, swapped in once every agent is done */
+	TArray<float> NewVelocityX;
+	TArray<float> NewVelocityY;
+	TArray<float> NewVelocityZ;
+
+	TArray<FVector> Targets;
+
+	/** Agents sorted by bucket, the agents of bucket B are SortedAgents[BucketStart[B]] to SortedAgents[BucketStart[B + 1]] */
+	TArray<int32> SortedAgents;
+	TArray<int32> BucketStart;
+	TArray<int32> AgentBucket;
+};
@@ -0,0 +1,139 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "FrameArena.h"
+#include "Futurum.h"
+#include "Misc/CoreDelegates.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Frame arena heap allocations"), STAT_FrameArenaHeapAllocations, STATGROUP_Futurum);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Frame arena allocations"), STAT_FrameArenaAllocations, STATGROUP_Futurum);
+DECLARE_MEMORY_STAT(TEXT("Frame arena used"), STAT_FrameArenaUsed, STATGROUP_Futurum);
+DECLARE_MEMORY_STAT(TEXT("Frame arena reserved"), STAT_FrameArenaReserved, STATGROUP_Futurum);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Module tick heap allocations"), STAT_ModuleTickHeapAllocations, STATGROUP_Futurum);
+
+FFrameAllocationScope::~FFrameAllocationScope()
+{
+#if STATS
+	for (int32 Index = 0; Index < NumWatched; ++Index)
+	{
+		const FWatched& Watched = Containers[Index];
+		if (Watched.GetAllocatedSize(Watched.Container) > Watched.AllocatedSize)
+		{
+			CountAllocation();
+		}
+	}
+#endif
+}
+
+void FFrameAllocationScope::CountAllocation()
+{
+	INC_DWORD_STAT(STAT_ModuleTickHeapAllocations);
+}
+
+FFrameArena& FFrameArena::Get()
+{
+	static FFrameArena Arena;
+	return Arena;
+}
+
+void FFrameArena::Startup()
+{
+	EndFrameHandle = FCoreDelegates::OnEndFrame.AddRaw(this, &FFrameArena::Reset);
+}
+
+void FFrameArena::Shutdown()
+{
+	FCoreDelegates::OnEndFrame.Remove(EndFrameHandle);
+	FreeBlocks();
+}
+
+void* FFrameArena::Allocate(SIZE_T Size, uint32 Alignment)
+{
+	check(IsInGameThread());
+	INC_DWORD_STAT(STAT_FrameArenaAllocations);
+
+	while (true)
+	{
+		if (Blocks.IsValidIndex(CurrentBlock))
+		{
+			FBlock& Block = Blocks[CurrentBlock];
+			const SIZE_T Start = Align(Offset, Alignment);
+			if (Start + Size <= Block.Size)
+			{
+				Offset = Start + Size;
+				FrameBytes += Size;
+				return Block.Data + Start;
+			}
+			if (CurrentBlock + 1 < Blocks.Num())
+			{
+				++CurrentBlock;
+				Offset = 0;
+				continue;
+			}
+		}
+
+		FBlock Block;
+		Block.Size = FMath::Max<SIZE_T>(DefaultBlockSize, Align(Size, Alignment));
+		Block.Data = (uint8*)FMemory::Malloc(Block.Size, DefaultAlignment);
+		INC_DWORD_STAT(STAT_FrameArenaHeapAllocations);
+		INC_MEMORY_STAT_BY(STAT_FrameArenaReserved, Block.Size);
+		FFrameAllocationScope::CountAllocation();
+		CurrentBlock = Blocks.Add(Block);
+		Offset = 0;
+	}
+}
+
+bool FFrameArena::TryGrow(void* Ptr, SIZE_T OldSize, SIZE_T NewSize)
+{
+	if (!Blocks.IsValidIndex(CurrentBlock) || NewSize < OldSize)
+	{
+		return false;
+	}
+
+	const FBlock& Block = Blocks[CurrentBlock];
+	if ((uint8*)Ptr + OldSize != Block.Data + Offset || Offset - OldSize + NewSize > Block.Size)
+	{
+		return false;
+	}
+	Offset += NewSize - OldSize;
+	FrameBytes += NewSize - OldSize;
+	return true;
+}
+
+void FFrameArena::Reset()
+{
+	SET_MEMORY_STAT(STAT_FrameArenaUsed, FrameBytes);
+
+	// Next frame gets the whole of this frame in a single block
+	if (Blocks.Num() > 1)
+	{
+		SIZE_T TotalSize = 0;
+		for (const FBlock& Block : Blocks)
+		{
+			TotalSize += Block.Size;
+		}
+		FreeBlocks();
+
+		FBlock Block;
+		Block.Size = TotalSize;
+		Block.Data = (uint8*)FMemory::Malloc(Block.Size, DefaultAlignment);
+		INC_DWORD_STAT(STAT_FrameArenaHeapAllocations);
+		INC_MEMORY_STAT_BY(STAT_FrameArenaReserved, Block.Size);
+		Blocks.Add(Block);
+	}
+
+	CurrentBlock = 0;
+	Offset = 0;
+	FrameBytes = 0;
+}
+
+void FFrameArena::FreeBlocks()
+{
+	for (const FBlock& Block : Blocks)
+	{
+		FMemory::Free(Block.Data);
+		DEC_MEMORY_STAT_BY(STAT_FrameArenaReserved, Block.Size);
+	}
+	Blocks.Reset();
+	CurrentBlock = 0;
+	Offset = 0;
+}
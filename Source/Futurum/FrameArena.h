@@ -0,0 +1,209 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/ContainerAllocationPolicies.h"
+
+/**
+ * Linear allocator for game thread scratch data, emptied at the end of every frame.
+ * Its blocks are kept between frames and merged into one after a frame that needed
+ * more than one, so once the peak frame has been seen it stops touching the heap.
+ */
+class FUTURUM_API FFrameArena
+{
+public:
+	static FFrameArena& Get();
+
+	/** Hooks the arena to the end of frame, called by the module */
+	void Startup();
+
+	void Shutdown();
+
+	void* Allocate(SIZE_T Size, uint32 Alignment = DefaultAlignment);
+
+	/** Grows the last allocation in place, returns false if Ptr is not the last allocation or the block is full */
+	bool TryGrow(void* Ptr, SIZE_T OldSize, SIZE_T NewSize);
+
+	void Reset();
+
+private:
+	static const SIZE_T DefaultBlockSize = 64 * 1024;
+	static const uint32 DefaultAlignment = 16;
+
+	struct FBlock
+	{
+		uint8* Data;
+		SIZE_T Size;
+	};
+
+	void FreeBlocks();
+
+	TArray<FBlock, TInlineAllocator<4>> Blocks;
+	int32 CurrentBlock = 0;
+	SIZE_T Offset = 0;
+	SIZE_T FrameBytes = 0;
+	FDelegateHandle EndFrameHandle;
+};
+
+/**
+ * Counts the heap allocations of the containers the module keeps between frames and fills in its
+ * ticks, shown as "Module tick heap allocations" under stat Futurum with the frame arena's own
+ * block allocations. Each watched container whose allocation grew while the scope was open
+ * counts once, so a steady-state frame should read zero. Only counts in builds with stats.
+ */
+class FUTURUM_API FFrameAllocationScope
+{
+public:
+	FFrameAllocationScope() = default;
+
+	~FFrameAllocationScope();
+
+	/** Anything with a GetAllocatedSize, engine containers or the module's own tables */
+	template<typename ContainerType>
+	FORCEINLINE void Watch(const ContainerType& Container)
+	{
+#if STATS
+		check(NumWatched < MaxWatched);
+		FWatched& Watched = Containers[NumWatched++];
+		Watched.Container = &Container;
+		Watched.GetAllocatedSize = [](const void* Ptr) { return (SIZE_T)((const ContainerType*)Ptr)->GetAllocatedSize(); };
+		Watched.AllocatedSize = Container.GetAllocatedSize();
+#endif
+	}
+
+	/** Counts a heap allocation the scope cannot see, such as a frame arena block */
+	static void CountAllocation();
+
+private:
+#if STATS
+	struct FWatched
+	{
+		const void* Container;
+		SIZE_T (*GetAllocatedSize)(const void*);
+		SIZE_T AllocatedSize;
+	};
+
+	static const int32 MaxWatched = 8;
+	FWatched Containers[MaxWatched];
+	int32 NumWatched = 0;
+#endif
+};
+
+/**
+ * TArray allocator taking its memory from the frame arena. Only for arrays that live
+ * within a frame on the game thread, the memory is gone once the frame ends.
+ */
+class FFrameArenaAllocator
+{
+public:
+	enum { NeedsElementType = false };
+	enum { RequireRangeCheck = true };
+
+	class ForAnyElementType
+	{
+	public:
+		ForAnyElementType()
+			: Data(nullptr)
+		{
+		}
+
+		FORCEINLINE void MoveToEmpty(ForAnyElementType& Other)
+		{
+			checkSlow(this != &Other);
+			Data = Other.Data;
+			AllocatedBytes = Other.AllocatedBytes;
+			Other.Data = nullptr;
+			Other.AllocatedBytes = 0;
+		}
+
+		FORCEINLINE FScriptContainerElement* GetAllocation() const
+		{
+			return Data;
+		}
+
+		void ResizeAllocation(int32 PreviousNumElements, int32 NumElements, SIZE_T NumBytesPerElement)
+		{
+			if (NumElements == 0)
+			{
+				Data = nullptr;
+				return;
+			}
+
+			// Elements past PreviousNumElements are not constructed, only the live ones move
+			const SIZE_T PreviousBytes = PreviousNumElements * NumBytesPerElement;
+			const SIZE_T NewBytes = NumElements * NumBytesPerElement;
+			if (Data && FFrameArena::Get().TryGrow(Data, AllocatedBytes, NewBytes))
+			{
+				AllocatedBytes = NewBytes;
+				return;
+			}
+
+			FScriptContainerElement* NewData = (FScriptContainerElement*)FFrameArena::Get().Allocate(NewBytes);
+			if (Data && PreviousBytes > 0)
+			{
+				FMemory::Memcpy(NewData, Data, FMath::Min(PreviousBytes, NewBytes));
+			}
+			Data = NewData;
+			AllocatedBytes = NewBytes;
+		}
+
+		FORCEINLINE int32 CalculateSlackReserve(int32 NumElements, int32 NumBytesPerElement) const
+		{
+			return NumElements;
+		}
+
+		FORCEINLINE int32 CalculateSlackShrink(int32 NumElements, int32 NumAllocatedElements, int32 NumBytesPerElement) const
+		{
+			// Shrinking gives nothing back to a linear arena
+			return NumAllocatedElements;
+		}
+
+		FORCEINLINE int32 CalculateSlackGrow(int32 NumElements, int32 NumAllocatedElements, int32 NumBytesPerElement) const
+		{
+			return DefaultCalculateSlackGrow(NumElements, NumAllocatedElements, NumBytesPerElement, false);
+		}
+
+		SIZE_T GetAllocatedSize(int32 NumAllocatedElements, SIZE_T NumBytesPerElement) const
+		{
+			return NumAllocatedElements * NumBytesPerElement;
+		}
+
+		bool HasAllocation()
+		{
+			return !!Data;
+		}
+
+	private:
+		ForAnyElementType(const ForAnyElementType&);
+		ForAnyElementType& operator=(const ForAnyElementType&);
+
+		FScriptContainerElement* Data;
+		SIZE_T AllocatedBytes = 0;
+	};
+
+	template<typename ElementType>
+	class ForElementType : public ForAnyElementType
+	{
+	public:
+		ForElementType()
+		{
+		}
+
+		FORCEINLINE ElementType* GetAllocation() const
+		{
+			return (ElementType*)ForAnyElementType::GetAllocation();
+		}
+	};
+};
+
+template <>
+struct TAllocatorTraits<FFrameArenaAllocator> : TAllocatorTraitsBase<FFrameArenaAllocator>
+{
+	enum { SupportsMove = true };
+	enum { IsZeroConstruct = true };
+};
+
+/** Scratch array for the current frame */
+template<typename ElementType>
+using TFrameArray = TArray<ElementType, FFrameArenaAllocator>;
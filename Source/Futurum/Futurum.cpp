@@ -2,6 +2,31 @@
 
 #include "Futurum.h"
 #include "Modules/ModuleManager.h"
+#include "FrameArena.h"
+#include "GarbageCollectionStats.h"
+#include "NetMetrics.h"
+#include "MatchSnapshot.h"
 
-IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, Futurum, "Futurum" );
- 
\ No newline at end of file
+class FFuturumModule : public FDefaultGameModuleImpl
+{
+public:
+	virtual void StartupModule() override
+	{
+		FFrameArena::Get().Startup();
+		FGarbageCollectionStats::Get().Startup();
+		FNetMetrics::Get().Startup();
+		FMatchSnapshot::Startup();
+	}
+
+	virtual void ShutdownModule() override
+	{
+		FMatchSnapshot::Shutdown();
+		FNetMetrics::Get().Shutdown();
+		FGarbageCollectionStats::Get().Shutdown();
+		FFrameArena::Get().Shutdown();
+	}
+};
+
+IMPLEMENT_PRIMARY_GAME_MODULE( FFuturumModule, Futurum, "Futurum" );
+
+DEFINE_LOG_CATEGORY(LogFuturum);
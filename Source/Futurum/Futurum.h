@@ -3,3 +3,7 @@
 #pragma once
 
 #include "CoreMinimal.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogFuturum, Log, All);
+
+DECLARE_STATS_GROUP(TEXT("Futurum"), STATGROUP_Futurum, STATCAT_Advanced);
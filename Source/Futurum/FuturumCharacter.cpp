@@ -1,12 +1,22 @@
 // Copyright 1998-2018 Epic Games, Inc. All Rights Reserved.
 
 #include "FuturumCharacter.h"
+#include "Futurum.h"
+#include "FrameArena.h"
+#include "NetMetrics.h"
 #include "FuturumProjectile.h"
+#include "FuturumGameState.h"
+#include "FuturumGameMode.h"
+#include "FuturumCollision.h"
+#include "BallEnemy.h"
 #include "Animation/AnimInstance.h"
 #include "Camera/CameraComponent.h"
 #include "Components/CapsuleComponent.h"
 #include "Components/InputComponent.h"
+#include "GameFramework/ProjectileMovementComponent.h"
 #include "GameFramework/InputSettings.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/PlayerController.h"
 #include "HeadMountedDisplayFunctionLibrary.h"
 #include "Kismet/GameplayStatics.h"
 #include "MotionControllerComponent.h"
@@ -15,13 +25,52 @@
 #include "Net/UnrealNetwork.h"
 #include "ConstructorHelpers.h"
 #include "Classes/Animation/AnimBlueprint.h"
+#include "HAL/IConsoleManager.h"
 
 // for FXRMotionControllerBase::RightHandSourceId
 
-#define Interactable ECC_GameTraceChannel2
-
 DEFINE_LOG_CATEGORY_STATIC(LogFPChar, Warning, All);
 
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Rejected fire commands"), STAT_RejectedFireCommands, STATGROUP_Futurum);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Rejected use requests"), STAT_RejectedUseRequests, STATGROUP_Futurum);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Coalesced fire commands"), STAT_CoalescedFireCommands, STATGROUP_Futurum);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Redundant fire commands"), STAT_RedundantFireCommands, STATGROUP_Futurum);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Shot confirm latency (ms)"), STAT_ShotConfirmLatency, STATGROUP_Futurum);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Shot input to visual latency (ms)"), STAT_ShotVisualLatency, STATGROUP_Futurum);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Far simulated characters"), STAT_FarSimulatedCharacters, STATGROUP_Futurum);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Throttled character updates"), STAT_ThrottledCharacterUpdates, STATGROUP_Futurum);
+
+static TAutoConsoleVariable<int32> CVarPredictShots(
+	TEXT("Futurum.PredictShots"),
+	1,
+	TEXT("Shows a local projectile as soon as a client fires, instead of waiting for the server's one."));
+
+static TAutoConsoleVariable<float> CVarProxyLODDistance(
+	TEXT("Futurum.ProxyLODDistance"),
+	3000.f,
+	TEXT("Distance from the local view beyond which other players' characters move at a reduced rate and skip their animation. 0 keeps them all at full rate."));
+
+static TAutoConsoleVariable<float> CVarProxyLODTickInterval(
+	TEXT("Futurum.ProxyLODTickInterval"),
+	0.1f,
+	TEXT("Seconds between two movement updates of a far character on a client."));
+
+static TAutoConsoleVariable<float> CVarNetThrottleDistance(
+	TEXT("Futurum.NetThrottleDistance"),
+	5000.f,
+	TEXT("Distance from a client's view beyond which the server throttles the movement updates of a character sent to that client."));
+
+static TAutoConsoleVariable<float> CVarNetThrottleInterval(
+	TEXT("Futurum.NetThrottleInterval"),
+	0.5f,
+	TEXT("Seconds a far character waits before it competes again for a client's bandwidth. 0 to not throttle."));
+
+/** Seconds between two checks of the distance of a simulated character */
+static const float ProxyLODCheckInterval = 0.25f;
+
+/** Longest a client waits for the server's projectile of a shot */
+static const float PendingShotTimeout = 5.f;
+
 //////////////////////////////////////////////////////////////////////////
 // AFuturumCharacter
 
@@ -53,7 +102,7 @@ AFuturumCharacter::AFuturumCharacter()
 	{
 		Mesh1P->SetAnimInstanceClass(Animation.Object->GeneratedClass);
 	}
-	Mesh1P->SetOnlyOwnerSee(false);
+	Mesh1P->SetOnlyOwnerSee(true);
 	Mesh1P->SetupAttachment(FirstPersonCameraComponent);
 	Mesh1P->bCastDynamicShadow = false;
 	Mesh1P->CastShadow = false;
@@ -67,7 +116,7 @@ AFuturumCharacter::AFuturumCharacter()
 	{
 		FP_Gun->SetSkeletalMesh(GunMesh.Object);
 	}
-	FP_Gun->SetOnlyOwnerSee(false);			// only the owning player will see this mesh
+	FP_Gun->SetOnlyOwnerSee(true);			// only the owning player will see this mesh
 	FP_Gun->bCastDynamicShadow = false;
 	FP_Gun->CastShadow = false;
 	// FP_Gun->SetupAttachment(Mesh1P, TEXT("GripPoint"));
@@ -111,6 +160,142 @@ void AFuturumCharacter::BeginPlay()
 
 	//Attach gun mesh component to Skeleton, doing it here because the skeleton is not yet created in the constructor
 	FP_Gun->AttachToComponent(Mesh1P, FAttachmentTransformRules(EAttachmentRule::SnapToTarget, true), TEXT("GripPoint"));
+
+	FireBucket = FTokenBucket(FireBurst, FireRate);
+	UseBucket = FTokenBucket(UseBurst, UseRate);
+
+	AFuturumGameState* GameState = GetWorld()->GetGameState<AFuturumGameState>();
+	if (GameState)
+	{
+		GameState->RegisterBudgetedLight(SpotLight);
+	}
+}
+
+void AFuturumCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	AFuturumGameState* GameState = GetWorld()->GetGameState<AFuturumGameState>();
+	if (GameState)
+	{
+		GameState->UnregisterBudgetedLight(SpotLight);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void AFuturumCharacter::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	FFrameAllocationScope AllocationScope;
+	AllocationScope.Watch(PendingFireCommands);
+	AllocationScope.Watch(PendingShots);
+	if (Role == ROLE_SimulatedProxy)
+	{
+		UpdateProxyLOD(DeltaSeconds);
+	}
+
+	// Send at most one fire window per tick, however many shots were queued since the last one
+	if (FireResendsLeft > 0 && Role < ROLE_Authority)
+	{
+		ServerOnFire(PendingFireCommands);
+		--FireResendsLeft;
+	}
+
+	const float Now = GetWorld()->GetTimeSeconds();
+	for (auto It = PendingShots.CreateIterator(); It; ++It)
+	{
+		// A predicted shot is seen once its projectile has been drawn, which the game thread learns a frame later
+		FPendingShot& Shot = It.Value();
+		if (Shot.bPredicted && !Shot.bRendered && Shot.Projectile.IsValid() && Shot.Projectile->GetLastRenderTime() >= Shot.FireTime)
+		{
+			Shot.bRendered = true;
+			SET_FLOAT_STAT(STAT_ShotVisualLatency, (FPlatformTime::Seconds() - Shot.InputTime) * 1000.0);
+		}
+
+		// Lost to the network for good
+		if (Now - Shot.FireTime > PendingShotTimeout)
+		{
+			It.RemoveCurrent();
+		}
+	}
+}
+
+void AFuturumCharacter::UpdateProxyLOD(float DeltaSeconds)
+{
+	if (bFarProxy)
+	{
+		INC_DWORD_STAT(STAT_FarSimulatedCharacters);
+	}
+
+	ProxyLODTime += DeltaSeconds;
+	APlayerController* LocalPlayer = GetWorld()->GetFirstPlayerController();
+	if (ProxyLODTime < ProxyLODCheckInterval || !LocalPlayer || !LocalPlayer->IsLocalController())
+	{
+		return;
+	}
+	ProxyLODTime = 0.f;
+
+	FVector ViewLocation;
+	FRotator ViewRotation;
+	LocalPlayer->GetPlayerViewPoint(ViewLocation, ViewRotation);
+	const float Distance = CVarProxyLODDistance.GetValueOnGameThread();
+	const bool bFar = Distance > 0.f && FVector::DistSquared(ViewLocation, GetActorLocation()) > FMath::Square(Distance);
+	if (bFar == bFarProxy)
+	{
+		return;
+	}
+	bFarProxy = bFar;
+
+	// Smoothed less often and more simply, a far character only needs to be roughly in place
+	UCharacterMovementComponent* Movement = GetCharacterMovement();
+	Movement->SetComponentTickInterval(bFar ? CVarProxyLODTickInterval.GetValueOnGameThread() : 0.f);
+	Movement->NetworkSmoothingMode = bFar ? ENetworkSmoothingMode::Linear : ENetworkSmoothingMode::Exponential;
+	Movement->bNetworkSkipProxyPredictionOnNetUpdate = bFar;
+
+	// The arms are only drawn for their owner, nothing reads their pose on a simulated character
+	Mesh1P->SetComponentTickEnabled(!bFar);
+	FP_Gun->SetComponentTickEnabled(!bFar);
+}
+
+float AFuturumCharacter::GetNetPriority(const FVector& ViewPos, const FVector& ViewDir, AActor* Viewer, AActor* ViewTarget, UActorChannel* InChannel, float Time, bool bLowBandwidth)
+{
+	// Between two updates a far character gives way to everything else on the connection, its own client is never throttled
+	const float Interval = CVarNetThrottleInterval.GetValueOnGameThread();
+	const float Distance = CVarNetThrottleDistance.GetValueOnGameThread();
+	if (Interval > 0.f && Time < Interval && ViewTarget != this && Viewer != GetController()
+		&& FVector::DistSquared(ViewPos, GetActorLocation()) > FMath::Square(Distance))
+	{
+		INC_DWORD_STAT(STAT_ThrottledCharacterUpdates);
+		return 0.f;
+	}
+	return Super::GetNetPriority(ViewPos, ViewDir, Viewer, ViewTarget, InChannel, Time, bLowBandwidth);
+}
+
+void AFuturumCharacter::ConfirmShot(AFuturumProjectile* Projectile)
+{
+	FPendingShot Shot;
+	if (!PendingShots.RemoveAndCopyValue(Projectile->ShotSequence, Shot))
+	{
+		return;
+	}
+
+	const float Latency = (GetWorld()->GetTimeSeconds() - Shot.FireTime) * 1000.f;
+	SET_FLOAT_STAT(STAT_ShotConfirmLatency, Latency);
+	if (!Shot.bPredicted)
+	{
+		SET_FLOAT_STAT(STAT_ShotVisualLatency, (FPlatformTime::Seconds() - Shot.InputTime) * 1000.0);
+		return;
+	}
+
+	// The server's projectile takes over in flight, or stays hidden if the predicted one already exploded
+	if (Shot.Projectile.IsValid())
+	{
+		Shot.Projectile->Destroy();
+	}
+	else
+	{
+		Projectile->SuppressEffects();
+	}
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -155,22 +340,11 @@ void AFuturumCharacter::OnUse()
 	FRotator Rotation;
 	GetActorEyesViewPoint(Location, Rotation);
 
-	FHitResult LineTraceHit;
-	FCollisionQueryParams TraceParameters(FName(TEXT("")), false, this);
-	GetWorld()->LineTraceSingleByChannel(
-		OUT LineTraceHit,
-		Location,
-		Location + Rotation.Vector() * Reach,
-		Interactable
-	);
-	
-	AActor* ActorHit = LineTraceHit.GetActor();
-	
-	if (ActorHit)
-	{
-		bool bIsImplemented = ActorHit->GetClass()->ImplementsInterface(UInteractable::StaticClass());
-		IInteractable* ReactingObject = Cast<IInteractable>(ActorHit);
-		ReactingObject->Use();
+	// Traced along with the other use requests of this frame
+	AFuturumGameMode* GameMode = GetWorld()->GetAuthGameMode<AFuturumGameMode>();
+	if (GameMode)
+	{
+		GameMode->QueueUse(this, Location, Location + Rotation.Vector() * Reach);
 	}
 }
 
@@ -178,26 +352,96 @@ void AFuturumCharacter::OnFire()
 {
 	if (Role < ROLE_Authority)
 	{
-		ServerOnFire();
+		FFireCommand Command;
+		Command.Sequence = NextFireSequence++;
+		Command.Aim = GetControlRotation();
+		Command.ShotTime = GetWorld()->GetGameState() ? GetWorld()->GetGameState()->GetServerWorldTimeSeconds() : GetWorld()->GetTimeSeconds();
+		// Zero marks projectiles fired on the server
+		if (NextFireSequence == 0)
+		{
+			NextFireSequence = 1;
+		}
+		if (PendingFireCommands.Num() == MaxFireCommandsPerBatch)
+		{
+			PendingFireCommands.RemoveAt(0, 1, false);
+		}
+		PendingFireCommands.Add(Command);
+		FireResendsLeft = FireRedundancy;
+		PredictShot(Command);
+		return;
+	}
+	FireProjectile(GetControlRotation(), GetWorld()->GetTimeSeconds());
+}
+
+void AFuturumCharacter::PredictShot(const FFireCommand& Command)
+{
+	FPendingShot& Shot = PendingShots.Add(Command.Sequence);
+	Shot.FireTime = GetWorld()->GetTimeSeconds();
+	Shot.InputTime = FPlatformTime::Seconds();
+	Shot.bPredicted = CVarPredictShots.GetValueOnGameThread() != 0 && ProjectileClass != nullptr;
+	if (!Shot.bPredicted)
+	{
 		return;
 	}
+
+	const FVector SpawnLocation = ((FP_MuzzleLocation != nullptr) ? FP_MuzzleLocation->GetComponentLocation() : GetActorLocation()) + Command.Aim.RotateVector(GunOffset);
+	AFuturumProjectile* Projectile = GetWorld()->SpawnActorDeferred<AFuturumProjectile>(ProjectileClass, FTransform(Command.Aim, SpawnLocation),
+		this, this, ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+	if (Projectile)
+	{
+		Projectile->bPredicted = true;
+		Projectile->ShotSequence = Command.Sequence;
+		Projectile->SetFlags(RF_Transient);
+		Projectile->FinishSpawning(FTransform(Command.Aim, SpawnLocation));
+		Shot.Projectile = Projectile;
+	}
+
+	PlayFireEffects();
+}
+
+void AFuturumCharacter::ClientRejectShot_Implementation(uint16 Sequence)
+{
+	FPendingShot Shot;
+	if (PendingShots.RemoveAndCopyValue(Sequence, Shot) && Shot.Projectile.IsValid())
+	{
+		Shot.Projectile->Destroy();
+	}
+}
+
+void AFuturumCharacter::FireProjectile(const FRotator& SpawnRotation, float ShotTime, uint16 Sequence)
+{
 	// try and fire a projectile
 	if (ProjectileClass != NULL)
 	{
 		UWorld* const World = GetWorld();
 		if (World != NULL)
 		{
-			const FRotator SpawnRotation = GetControlRotation();
 			// MuzzleOffset is in camera space, so transform it to world space before offsetting from the character location to find the final muzzle position
-			const FVector SpawnLocation = ((FP_MuzzleLocation != nullptr) ? FP_MuzzleLocation->GetComponentLocation() : GetActorLocation()) + SpawnRotation.RotateVector(GunOffset);
+			FVector SpawnLocation = ((FP_MuzzleLocation != nullptr) ? FP_MuzzleLocation->GetComponentLocation() : GetActorLocation()) + SpawnRotation.RotateVector(GunOffset);
+			SpawnLocation = GetLagCompensatedLocation(SpawnLocation, SpawnRotation.Vector(), ShotTime);
 
 			//Set Spawn Collision Handling Override
 			FActorSpawnParameters ActorSpawnParams;
 			ActorSpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
-			World->SpawnActor<AFuturumProjectile>(ProjectileClass, SpawnLocation, SpawnRotation, ActorSpawnParams);
+			ActorSpawnParams.ObjectFlags |= RF_Transient;
+			// Lets the shooter's client match the projectile with its predicted one
+			ActorSpawnParams.Owner = this;
+			ActorSpawnParams.Instigator = this;
+			ActorSpawnParams.bDeferConstruction = true;
+			AFuturumProjectile* Projectile = World->SpawnActor<AFuturumProjectile>(ProjectileClass, SpawnLocation, SpawnRotation, ActorSpawnParams);
+			if (Projectile)
+			{
+				Projectile->ShotSequence = Sequence;
+				Projectile->FinishSpawning(FTransform(SpawnRotation, SpawnLocation));
+			}
 		}
 	}
 
+	PlayFireEffects();
+}
+
+void AFuturumCharacter::PlayFireEffects()
+{
 	// try and play the sound if specified
 	if (FireSound != NULL)
 	{
@@ -216,18 +460,89 @@ void AFuturumCharacter::OnFire()
 	}
 }
 
-void AFuturumCharacter::ServerOnFire_Implementation()
+FVector AFuturumCharacter::GetLagCompensatedLocation(const FVector& Start, const FVector& Direction, float ShotTime) const
 {
-	OnFire();
+	UWorld* const World = GetWorld();
+	const float Rewind = FMath::Clamp(World->GetTimeSeconds() - ShotTime, 0.f, MaxRewindTime);
+	AFuturumGameState* GameState = World->GetGameState<AFuturumGameState>();
+	if (Rewind <= 0.f || GameState == nullptr)
+	{
+		return Start;
+	}
+
+	// The part of the flight the shooter already saw before the command reached us
+	const float Speed = ProjectileClass->GetDefaultObject<AFuturumProjectile>()->GetProjectileMovement()->InitialSpeed;
+	FVector End = Start + Direction * Speed * Rewind;
+
+	FHitResult WorldHit;
+	if (World->LineTraceSingleByObjectType(WorldHit, Start, End, FuturumCollision::GetWorldStaticObjectParams(), FuturumCollision::GetProjectileQueryParams()))
+	{
+		End = WorldHit.Location - Direction * FMath::Min(10.f, WorldHit.Distance);
+	}
+
+	FVector HitLocation;
+	const ABallEnemy* Enemy = GameState->RewindSweep(World->GetTimeSeconds() - Rewind, Start, End, HitLocation);
+	if (Enemy)
+	{
+		// Confirmed against the past position, spawn right in front of the enemy so the hit lands now
+		return HitLocation - Direction * Enemy->HitRadius;
+	}
+	return End;
 }
 
-bool AFuturumCharacter::ServerOnFire_Validate()
+void AFuturumCharacter::ServerOnFire_Implementation(const TArray<FFireCommand>& Commands)
 {
-	return true;
+	static const UFunction* ServerOnFireFunction = StaticClass()->FindFunctionByName(GET_FUNCTION_NAME_CHECKED(AFuturumCharacter, ServerOnFire));
+	FNetMetrics::Get().RecordRPC(ServerOnFireFunction->GetFName(), GetNetConnection(),
+		FNetMetrics::GetParametersSize(ServerOnFireFunction, GetNetConnection(), Commands));
+
+	const float Now = GetWorld()->GetTimeSeconds();
+	int32 NewCommands = 0;
+	for (const FFireCommand& Command : Commands)
+	{
+		// Sequence numbers wrap around, so compare them through the signed distance
+		if (static_cast<int16>(static_cast<uint16>(Command.Sequence - LastFireSequence)) <= 0)
+		{
+			INC_DWORD_STAT(STAT_RedundantFireCommands);
+			continue;
+		}
+		LastFireSequence = Command.Sequence;
+		++NewCommands;
+
+		if (!FireBucket.TryConsume(Now))
+		{
+			INC_DWORD_STAT(STAT_RejectedFireCommands);
+			static const UFunction* ClientRejectShotFunction = StaticClass()->FindFunctionByName(GET_FUNCTION_NAME_CHECKED(AFuturumCharacter, ClientRejectShot));
+			FNetMetrics::Get().RecordRPC(ClientRejectShotFunction->GetFName(), GetNetConnection(),
+				FNetMetrics::GetParametersSize(ClientRejectShotFunction, GetNetConnection(), Command.Sequence));
+			ClientRejectShot(Command.Sequence);
+			continue;
+		}
+		FireProjectile(Command.Aim, Command.ShotTime, Command.Sequence);
+	}
+
+	if (NewCommands > 1)
+	{
+		INC_DWORD_STAT_BY(STAT_CoalescedFireCommands, NewCommands - 1);
+	}
+}
+
+bool AFuturumCharacter::ServerOnFire_Validate(const TArray<FFireCommand>& Commands)
+{
+	return Commands.Num() <= MaxFireCommandsPerBatch;
 }
 
 void AFuturumCharacter::ServerOnUse_Implementation()
 {
+	static const UFunction* ServerOnUseFunction = StaticClass()->FindFunctionByName(GET_FUNCTION_NAME_CHECKED(AFuturumCharacter, ServerOnUse));
+	FNetMetrics::Get().RecordRPC(ServerOnUseFunction->GetFName(), GetNetConnection(),
+		FNetMetrics::GetParametersSize(ServerOnUseFunction, GetNetConnection()));
+
+	if (!UseBucket.TryConsume(GetWorld()->GetTimeSeconds()))
+	{
+		INC_DWORD_STAT(STAT_RejectedUseRequests);
+		return;
+	}
 	OnUse();
 }
 
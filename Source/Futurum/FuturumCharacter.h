@@ -5,10 +5,30 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Character.h"
 #include "Engine/Classes/Components/SpotLightComponent.h"
+#include "TokenBucket.h"
 #include "FuturumCharacter.generated.h"
 
 class UInputComponent;
 
+/** A single shot requested by the owning client, sent to the server in batches. */
+USTRUCT()
+struct FFireCommand
+{
+	GENERATED_BODY()
+
+	/** Increases by one for every shot, wraps around */
+	UPROPERTY()
+	uint16 Sequence = 0;
+
+	/** Control rotation at the moment the shot was fired */
+	UPROPERTY()
+	FRotator Aim = FRotator::ZeroRotator;
+
+	/** Server world time as the client saw it when firing, used for lag compensation */
+	UPROPERTY()
+	float ShotTime = 0.f;
+};
+
 UCLASS(config=Game)
 class AFuturumCharacter : public ACharacter
 {
@@ -39,7 +59,17 @@ public:
 protected:
 	virtual void BeginPlay();
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 public:
+	virtual void Tick(float DeltaSeconds) override;
+
+	/** Far characters only get a turn at a client's bandwidth every Futurum.NetThrottleInterval seconds */
+	virtual float GetNetPriority(const FVector& ViewPos, const FVector& ViewDir, AActor* Viewer, AActor* ViewTarget, UActorChannel* InChannel, float Time, bool bLowBandwidth) override;
+
+	/** Called on the owning client when the server's projectile for one of its shots arrives */
+	void ConfirmShot(class AFuturumProjectile* Projectile);
+
 	/** Base turn rate, in deg/sec. Other scaling may affect final turn rate. */
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category=Camera)
 	float BaseTurnRate;
@@ -69,8 +99,27 @@ protected:
 	/** Fires a projectile. */
 	void OnFire();
 
-	UFUNCTION(Server, Reliable, WithValidation)
-	void ServerOnFire();
+	/** Lowers the movement and animation rate of another player's character when it is far from the local view */
+	void UpdateProxyLOD(float DeltaSeconds);
+
+	/** Spawns the projectile and plays the fire effects. Server only. */
+	void FireProjectile(const FRotator& SpawnRotation, float ShotTime, uint16 Sequence = 0);
+
+	/** Spawns a local projectile for a shot the server has not seen yet. Owning client only. */
+	void PredictShot(const FFireCommand& Command);
+
+	void PlayFireEffects();
+
+	/** Where a projectile fired at ShotTime should be now, checked against the enemies as the shooter saw them. */
+	FVector GetLagCompensatedLocation(const FVector& Start, const FVector& Direction, float ShotTime) const;
+
+	/** Receives the window of the most recent fire commands. Commands already processed are skipped. */
+	UFUNCTION(Server, Unreliable, WithValidation)
+	void ServerOnFire(const TArray<FFireCommand>& Commands);
+
+	/** The server dropped the shot, its predicted projectile goes away */
+	UFUNCTION(Client, Unreliable)
+	void ClientRejectShot(uint16 Sequence);
 
 	UFUNCTION(Server, Reliable, WithValidation)
 	void ServerOnUse();
@@ -112,6 +161,8 @@ public:
 	FORCEINLINE class USkeletalMeshComponent* GetMesh1P() const { return Mesh1P; }
 	/** Returns FirstPersonCameraComponent subobject **/
 	FORCEINLINE class UCameraComponent* GetFirstPersonCameraComponent() const { return FirstPersonCameraComponent; }
+	/** Returns SpotLight subobject **/
+	FORCEINLINE USpotLightComponent* GetSpotLight() const { return SpotLight; }
 
 private:
 	UPROPERTY(VisibleAnywhere)
@@ -119,5 +170,66 @@ private:
 	
 	UPROPERTY(VisibleAnywhere)
 	float MovementScale = 1.f;
+
+	/** Shots the server accepts in a burst from the owning client */
+	UPROPERTY(EditDefaultsOnly, Category = Gameplay)
+	float FireBurst = 4.f;
+
+	/** Shots per second the server accepts from the owning client */
+	UPROPERTY(EditDefaultsOnly, Category = Gameplay)
+	float FireRate = 8.f;
+
+	/** Use requests the server accepts in a burst from the owning client */
+	UPROPERTY(EditDefaultsOnly, Category = Gameplay)
+	float UseBurst = 2.f;
+
+	/** Use requests per second the server accepts from the owning client */
+	UPROPERTY(EditDefaultsOnly, Category = Gameplay)
+	float UseRate = 4.f;
+
+	/** How many consecutive ticks a fire window is resent, so a dropped packet does not lose shots */
+	UPROPERTY(EditDefaultsOnly, Category = Gameplay)
+	int32 FireRedundancy = 3;
+
+	/** Longest client latency the server compensates for when validating shots */
+	UPROPERTY(EditDefaultsOnly, Category = Gameplay)
+	float MaxRewindTime = 0.3f;
+
+	/** Largest fire window the client sends, a bigger one fails validation */
+	static const int32 MaxFireCommandsPerBatch = 8;
+
+	// Client side fire stream
+	TArray<FFireCommand> PendingFireCommands;
+	uint16 NextFireSequence = 1;
+	int32 FireResendsLeft = 0;
+
+	struct FPendingShot
+	{
+		/** Local time the shot was fired at */
+		float FireTime = 0.f;
+
+		/** Platform time of the fire input, for the visual latency */
+		double InputTime = 0.0;
+
+		/** Null once the predicted projectile exploded */
+		TWeakObjectPtr<AFuturumProjectile> Projectile;
+
+		bool bPredicted = false;
+
+		/** The predicted projectile has been drawn once */
+		bool bRendered = false;
+	};
+
+	/** Shots of the owning client waiting for the server's projectile, by sequence */
+	TMap<uint16, FPendingShot> PendingShots;
+
+	// Simulated proxy level of detail
+	float ProxyLODTime = 0.f;
+	bool bFarProxy = false;
+
+	// Server side rate limiting, one set per owning connection
+	uint16 LastFireSequence = 0;
+	FTokenBucket FireBucket;
+	FTokenBucket UseBucket;
 };
 
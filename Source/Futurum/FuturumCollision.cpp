@@ -0,0 +1,129 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "FuturumCollision.h"
+#include "Futurum.h"
+#include "AsyncSceneQueries.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("Line trace batch"), STAT_LineTraceBatch, STATGROUP_Futurum);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Batched line traces"), STAT_BatchedLineTraces, STATGROUP_Futurum);
+
+namespace FuturumCollision
+{
+	const FName ProjectileProfile(TEXT("Projectile"));
+	const FName InteractableProfile(TEXT("Interactable"));
+
+	const FCollisionQueryParams& GetInteractableQueryParams()
+	{
+		static const FCollisionQueryParams Params(SCENE_QUERY_STAT(InteractableTrace), false);
+		return Params;
+	}
+
+	const FCollisionQueryParams& GetProjectileQueryParams()
+	{
+		static const FCollisionQueryParams Params(SCENE_QUERY_STAT(ProjectileTrace), false);
+		return Params;
+	}
+
+	const FCollisionResponseParams& GetDefaultResponseParams()
+	{
+		return FCollisionResponseParams::DefaultResponseParam;
+	}
+
+	const FCollisionObjectQueryParams& GetWorldStaticObjectParams()
+	{
+		static const FCollisionObjectQueryParams Params(ECC_WorldStatic);
+		return Params;
+	}
+}
+
+int32 FLineTraceBatch::Add(const FVector& Start, const FVector& End, const AActor* IgnoredActor)
+{
+	FRay Ray;
+	Ray.Start = Start;
+	Ray.End = End;
+	Ray.IgnoredActor = IgnoredActor;
+	return Rays.Add(Ray);
+}
+
+void FLineTraceBatch::Run(UWorld* World, FAsyncSceneQueries& Queries, const UObject* Owner, ECollisionChannel Channel, const FCollisionQueryParams& Params, FContinuation&& Continuation)
+{
+	SCOPE_CYCLE_COUNTER(STAT_LineTraceBatch);
+	INC_DWORD_STAT_BY(STAT_BatchedLineTraces, Rays.Num());
+
+	if (Rays.Num() == 0)
+	{
+		Continuation(TArray<FHitResult>());
+		return;
+	}
+
+	// Filled in by the trace continuations, in whatever order they finish
+	struct FResults
+	{
+		TArray<FHitResult> Hits;
+		int32 PendingTraces = 0;
+		FContinuation Continuation;
+
+		/** Kept to trace a lost ray again */
+		TArray<FRay> Rays;
+		UWorld* World;
+		ECollisionChannel Channel;
+		FCollisionQueryParams Params;
+
+		void SetHit(int32 Index, const FHitResult& Hit)
+		{
+			Hits[Index] = Hit;
+			if (--PendingTraces == 0)
+			{
+				Continuation(Hits);
+			}
+		}
+
+		void TraceLostRay(int32 Index)
+		{
+			const FRay& Ray = Rays[Index];
+			FCollisionQueryParams RayParams = Params;
+			if (Ray.IgnoredActor.IsValid())
+			{
+				RayParams.AddIgnoredActor(Ray.IgnoredActor.Get());
+			}
+			FHitResult Hit;
+			World->LineTraceSingleByChannel(Hit, Ray.Start, Ray.End, Channel, RayParams);
+			SetHit(Index, Hit);
+		}
+	};
+	TSharedRef<FResults> Results = MakeShared<FResults>();
+	Results->Hits.SetNum(Rays.Num());
+	Results->PendingTraces = Rays.Num();
+	Results->Continuation = MoveTemp(Continuation);
+	Results->Rays = Rays;
+	Results->World = World;
+	Results->Channel = Channel;
+	Results->Params = Params;
+
+	for (int32 Index = 0; Index < Rays.Num(); ++Index)
+	{
+		const FRay& Ray = Rays[Index];
+		RayParams = Params;
+		if (Ray.IgnoredActor.IsValid())
+		{
+			RayParams.AddIgnoredActor(Ray.IgnoredActor.Get());
+		}
+
+		Queries.LineTrace(World, Owner, Ray.Start, Ray.End, Channel, RayParams,
+			[Results, Index](const FHitResult& Hit)
+			{
+				Results->SetHit(Index, Hit);
+			},
+			[Results, Index]()
+			{
+				Results->TraceLostRay(Index);
+			});
+	}
+	Rays.Reset();
+}
+
+void FLineTraceBatch::Reset()
+{
+	Rays.Reset();
+}
@@ -0,0 +1,66 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineTypes.h"
+#include "CollisionQueryParams.h"
+
+class UWorld;
+class FAsyncSceneQueries;
+
+/**
+ * Collision setup of the game, matching the channels and profiles of DefaultEngine.ini.
+ */
+namespace FuturumCollision
+{
+	const ECollisionChannel Projectile = ECC_GameTraceChannel1;
+	const ECollisionChannel Interactable = ECC_GameTraceChannel2;
+
+	FUTURUM_API extern const FName ProjectileProfile;
+	FUTURUM_API extern const FName InteractableProfile;
+
+	/** Shared by every query, they are built once and must not be modified */
+	FUTURUM_API const FCollisionQueryParams& GetInteractableQueryParams();
+	FUTURUM_API const FCollisionQueryParams& GetProjectileQueryParams();
+	FUTURUM_API const FCollisionResponseParams& GetDefaultResponseParams();
+	FUTURUM_API const FCollisionObjectQueryParams& GetWorldStaticObjectParams();
+}
+
+/**
+ * Line traces gathered together and run against one channel, so they share their query
+ * params and show up as one entry in the stats. The traces go through the async scene
+ * queries and every hit is handed back at once, when the last one is in. A trace the scene
+ * queries lost is run again as a blocking trace, so the batch always completes.
+ */
+class FUTURUM_API FLineTraceBatch
+{
+public:
+	typedef TFunction<void(const TArray<FHitResult>& Hits)> FContinuation;
+
+	/** Returns the index of the ray, which is also the index of its hit in the continuation */
+	int32 Add(const FVector& Start, const FVector& End, const AActor* IgnoredActor = nullptr);
+
+	/**
+	 * Traces every ray for its first blocking hit and empties the batch. The continuation runs
+	 * once, while Owner is alive, right away for an empty batch.
+	 */
+	void Run(UWorld* World, FAsyncSceneQueries& Queries, const UObject* Owner, ECollisionChannel Channel, const FCollisionQueryParams& Params, FContinuation&& Continuation);
+
+	void Reset();
+
+	FORCEINLINE int32 Num() const { return Rays.Num(); }
+
+private:
+	struct FRay
+	{
+		FVector Start;
+		FVector End;
+		TWeakObjectPtr<const AActor> IgnoredActor;
+	};
+
+	TArray<FRay> Rays;
+
+	/** Copy of the batch params with the ignored actor of the current ray */
+	FCollisionQueryParams RayParams;
+};
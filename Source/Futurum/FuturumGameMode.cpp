@@ -1,55 +1,346 @@
 // Copyright 1998-2018 Epic Games, Inc. All Rights Reserved.
 
 #include "FuturumGameMode.h"
+#include "Futurum.h"
 #include "FuturumHUD.h"
+#include "FuturumGameState.h"
 #include "FuturumCharacter.h"
+#include "FuturumPlayerController.h"
+#include "NetMetrics.h"
 #include "UObject/ConstructorHelpers.h"
 #include "BallEnemy.h"
+#include "InteractableDispatch.h"
+#include "FrameArena.h"
 #include "Engine/World.h"
 #include "Engine/StaticMesh.h"
-#include "Engine/Public/TimerManager.h"
+#include "Kismet/GameplayStatics.h"
+#include "Misc/Paths.h"
+#include "Engine/Engine.h"
+#include "HAL/IConsoleManager.h"
+
+namespace
+{
+	FString GetReplayFilename(const FString& ReplayName)
+	{
+		return FPaths::ProjectSavedDir() / TEXT("Replays") / ReplayName + TEXT(".futurumreplay");
+	}
+}
+
+static TAutoConsoleVariable<float> CVarCosmeticEventRadius(
+	TEXT("Futurum.CosmeticEventRadius"),
+	8000.f,
+	TEXT("Players further than this from a one shot effect are not sent it."));
+
+static FAutoConsoleCommand RestartMatchCommand(
+	TEXT("Futurum.RestartMatch"),
+	TEXT("Restarts every match hosted here from its start snapshot, without reloading the map."),
+	FConsoleCommandDelegate::CreateLambda([]()
+	{
+		for (const FWorldContext& Context : GEngine->GetWorldContexts())
+		{
+			UWorld* World = Context.World();
+			AFuturumGameMode* GameMode = World ? Cast<AFuturumGameMode>(World->GetAuthGameMode()) : nullptr;
+			if (GameMode)
+			{
+				GameMode->RestartMatchInPlace();
+			}
+		}
+	}));
 
 AFuturumGameMode::AFuturumGameMode()
 	: Super()
 {
+	PrimaryActorTick.bCanEverTick = true;
+
 	// set default pawn class to our Blueprinted character
 	static ConstructorHelpers::FClassFinder<APawn> PlayerPawnClassFinder(TEXT("Class'/Script/Futurum.FuturumCharacter'"));
 	DefaultPawnClass = PlayerPawnClassFinder.Class;
 
 	// use our custom HUD class
 	HUDClass = AFuturumHUD::StaticClass();
+	PlayerControllerClass = AFuturumPlayerController::StaticClass();
+	GameStateClass = AFuturumGameState::StaticClass();
 	BallEnemyClass = ABallEnemy::StaticClass();
 	
 	EventDispatcher = CreateDefaultSubobject<UEventDispatcher>(TEXT("Event Dispatcher"));
 	EventDispatcher->OnEnemyDestroyed.AddDynamic(this, &AFuturumGameMode::SpawnEnemyWithLights);
 }
 
+void AFuturumGameMode::InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage)
+{
+	Super::InitGame(MapName, Options, ErrorMessage);
+
+	ReplayToRecord = UGameplayStatics::ParseOption(Options, TEXT("RecordReplay"));
+	ReplayToPlay = UGameplayStatics::ParseOption(Options, TEXT("PlayReplay"));
+}
+
 void AFuturumGameMode::StartPlay()
 {
 	Super::StartPlay();
+
+	// A played back match brings its own enemies
+	if (!ReplayToPlay.IsEmpty())
+	{
+		ReplayPlayer = MakeUnique<FReplayPlayer>(GetWorld(), BallEnemyClass);
+		if (ReplayPlayer->Load(GetReplayFilename(ReplayToPlay)))
+		{
+			return;
+		}
+		ReplayPlayer.Reset();
+	}
+
+	if (!ReplayToRecord.IsEmpty())
+	{
+		ReplayRecorder = MakeUnique<FReplayRecorder>(GetWorld(), GetReplayFilename(ReplayToRecord));
+	}
 	SpawnEnemy();
+
+	TArray<FMatchTimer> PendingTimers;
+	GetMatchTimers(PendingTimers);
+	StartSnapshot.Capture(GetWorld(), BallEnemyClass, PendingTimers);
+}
+
+void AFuturumGameMode::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	ReplayRecorder.Reset();
+	ReplayPlayer.Reset();
+	SpawnLocations.Reset();
+	StartSnapshot.Reset();
+	Timers.Reset();
+	MatchTimers.Reset();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void AFuturumGameMode::RestartMatchInPlace()
+{
+	if (!StartSnapshot.IsValid())
+	{
+		UE_LOG(LogFuturum, Warning, TEXT("No start snapshot to restart the match from"));
+		return;
+	}
+
+	// Drop everything scheduled by the old match, then schedule what was pending at the start
+	Timers.Reset();
+	MatchTimers.Reset();
+	ResolvedUses.Reset();
+	SpawnLocations.Reset();
+
+	StartSnapshot.Restore(GetWorld());
+	for (const FMatchTimer& Timer : StartSnapshot.GetTimers())
+	{
+		ScheduleMatchTimer(Timer.Type, Timer.Remaining);
+	}
+}
+
+void AFuturumGameMode::ScheduleMatchTimer(EMatchTimer Type, float Delay)
+{
+	MatchTimers.RemoveAllSwap([this](const FScheduledMatchTimer& Timer)
+	{
+		return Timers.GetTimeRemaining(Timer.Handle) < 0.f;
+	});
+
+	FScheduledMatchTimer Timer;
+	Timer.Type = Type;
+	Timer.Handle = Timers.Schedule(Delay, [this, Type]()
+	{
+		RunMatchTimer(Type);
+	});
+	MatchTimers.Add(Timer);
+}
+
+void AFuturumGameMode::RunMatchTimer(EMatchTimer Type)
+{
+	switch (Type)
+	{
+	case EMatchTimer::LightsOn:
+		SetLightsState(true);
+		break;
+	}
+}
+
+void AFuturumGameMode::GetMatchTimers(TArray<FMatchTimer>& OutTimers) const
+{
+	for (const FScheduledMatchTimer& Timer : MatchTimers)
+	{
+		const float Remaining = Timers.GetTimeRemaining(Timer.Handle);
+		if (Remaining >= 0.f)
+		{
+			OutTimers.Add({ Timer.Type, Remaining });
+		}
+	}
+}
+
+void AFuturumGameMode::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	FFrameAllocationScope AllocationScope;
+	AllocationScope.Watch(Timers);
+	AllocationScope.Watch(ResolvedUses);
+	AllocationScope.Watch(CosmeticEvents);
+	AllocationScope.Watch(NearbyEvents);
+	AllocationScope.Watch(SpawnLocations);
+	Timers.Advance(DeltaSeconds);
+	FlushUses();
+	FlushCosmeticEvents();
+
+	if (!ReplayPlayer.IsValid())
+	{
+		SpawnLocations.Tick(GetWorld());
+	}
+
+	if (ReplayRecorder.IsValid())
+	{
+		ReplayRecorder->RecordFrame();
+	}
+	if (ReplayPlayer.IsValid())
+	{
+		ReplayPlayer->Tick(DeltaSeconds);
+	}
+}
+
+void AFuturumGameMode::RecordReplayEvent(EReplayEvent Type, const FVector& Location, const FRotator& Rotation)
+{
+	if (ReplayRecorder.IsValid())
+	{
+		ReplayRecorder->AddEvent(Type, Location, Rotation);
+	}
+}
+
+void AFuturumGameMode::QueueUse(AActor* User, const FVector& Start, const FVector& End)
+{
+	AFuturumGameState* FuturumGameState = GetGameState<AFuturumGameState>();
+	if (!FuturumGameState)
+	{
+		return;
+	}
+
+	FCollisionQueryParams Params = FuturumCollision::GetInteractableQueryParams();
+	Params.AddIgnoredActor(User);
+	// Dropped if the user is gone by the time the trace is done
+	FuturumGameState->GetSceneQueries().LineTrace(GetWorld(), User, Start, End, FuturumCollision::Interactable, Params, [this](const FHitResult& Hit)
+	{
+		ResolvedUses.Add(Hit);
+	});
+}
+
+void AFuturumGameMode::FlushUses()
+{
+	if (ResolvedUses.Num() == 0)
+	{
+		return;
+	}
+
+	// Uses of the same type run back to back
+	struct FUse
+	{
+		EInteractableType Type;
+		int32 Index;
+
+		bool operator<(const FUse& Other) const { return Type < Other.Type; }
+	};
+	TFrameArray<FUse> Uses;
+	for (int32 Index = 0; Index < ResolvedUses.Num(); ++Index)
+	{
+		// Null if the hit actor was destroyed since the trace
+		const EInteractableType Type = FInteractableDispatch::GetCachedType(ResolvedUses[Index].GetActor());
+		if (Type != EInteractableType::None)
+		{
+			Uses.Add({ Type, Index });
+		}
+	}
+	Uses.StableSort();
+
+	for (const FUse& Use : Uses)
+	{
+		const FHitResult& Hit = ResolvedUses[Use.Index];
+		FInteractableDispatch::Use(Use.Type, Hit.GetActor(), Hit.Item);
+	}
+	ResolvedUses.Reset();
+}
+
+void AFuturumGameMode::SendCosmeticEvent(UParticleSystem* Particles, USoundBase* Sound, const FVector& Location)
+{
+	// The same effect twice on one spot in a frame is sent once
+	for (const FCosmeticEvent& Event : CosmeticEvents)
+	{
+		if (Event.Particles == Particles && Event.Sound == Sound && FVector::DistSquared(Event.Location, Location) < FMath::Square(100.f))
+		{
+			return;
+		}
+	}
+
+	FCosmeticEvent& Event = CosmeticEvents[CosmeticEvents.AddDefaulted()];
+	Event.Particles = Particles;
+	Event.Sound = Sound;
+	Event.Location = Location;
+}
+
+void AFuturumGameMode::FlushCosmeticEvents()
+{
+	if (CosmeticEvents.Num() == 0)
+	{
+		return;
+	}
+
+	const float RadiusSquared = FMath::Square(CVarCosmeticEventRadius.GetValueOnGameThread());
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		AFuturumPlayerController* Controller = Cast<AFuturumPlayerController>(It->Get());
+		AActor* ViewTarget = Controller ? Controller->GetViewTarget() : nullptr;
+		if (!ViewTarget)
+		{
+			continue;
+		}
+
+		NearbyEvents.Reset();
+		const FVector ViewLocation = ViewTarget->GetActorLocation();
+		for (const FCosmeticEvent& Event : CosmeticEvents)
+		{
+			if (FVector::DistSquared(Event.Location, ViewLocation) <= RadiusSquared)
+			{
+				NearbyEvents.Add(Event);
+			}
+		}
+
+		if (NearbyEvents.Num() > 0)
+		{
+			static const UFunction* ClientCosmeticEventsFunction = AFuturumPlayerController::StaticClass()->FindFunctionByName(GET_FUNCTION_NAME_CHECKED(AFuturumPlayerController, ClientCosmeticEvents));
+			FNetMetrics::Get().RecordRPC(ClientCosmeticEventsFunction->GetFName(), Controller->GetNetConnection(),
+				FNetMetrics::GetParametersSize(ClientCosmeticEventsFunction, Controller->GetNetConnection(), NearbyEvents));
+			Controller->ClientCosmeticEvents(NearbyEvents);
+		}
+	}
+	CosmeticEvents.Reset();
 }
 
 void AFuturumGameMode::SpawnEnemyWithLights()
 {
-	if (Role == ROLE_Authority)
+	if (Role == ROLE_Authority && !ReplayPlayer.IsValid())
 	{
 		UWorld* const World = GetWorld();
 		if (World != NULL)
 		{
 			FActorSpawnParameters ActorSpawnParams;
 			ActorSpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
-			FVector StartLocation(FMath::RandRange(-1250.f, 1250.f), FMath::RandRange(-1250.f, 1250.f), 500.f);
+			ActorSpawnParams.ObjectFlags |= RF_Transient;
+			FVector StartLocation;
+			if (SpawnLocations.Pop(World, StartLocation))
+			{
+				// Already checked for room, skip the encroachment test
+				ActorSpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+			}
+			else
+			{
+				StartLocation = FVector(FMath::RandRange(-1250.f, 1250.f), FMath::RandRange(-1250.f, 1250.f), 500.f);
+			}
 			ABallEnemy* Enemy = World->SpawnActor<ABallEnemy>(BallEnemyClass, StartLocation, FRotator::ZeroRotator, ActorSpawnParams);
 
 			FVector StartVelocity(FMath::RandRange(-1250.f, 1250.f), FMath::RandRange(-1250.f, 1250.f), FMath::RandRange(-1250.f, 1250.f));
 			Enemy->StaticMesh->SetPhysicsLinearVelocity(StartVelocity);
 
-			FTimerHandle LightsTimerHandle;
-			FTimerDelegate LightsTimerDelegate;
-			bool State = true;
-			LightsTimerDelegate.BindUFunction(this, FName("SetLightsState"), State);
-			World->GetTimerManager().SetTimer(LightsTimerHandle, LightsTimerDelegate, 3.f, false);
+			ScheduleMatchTimer(EMatchTimer::LightsOn, 3.f);
 		}
 	}
 }
@@ -63,16 +354,21 @@ void AFuturumGameMode::SpawnEnemy()
 		{
 			FActorSpawnParameters ActorSpawnParams;
 			ActorSpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
-			FVector StartLocation(FMath::RandRange(-1250.f, 1250.f), FMath::RandRange(-1250.f, 1250.f), 500.f);
+			ActorSpawnParams.ObjectFlags |= RF_Transient;
+			FVector StartLocation;
+			if (SpawnLocations.Pop(World, StartLocation))
+			{
+				// Already checked for room, skip the encroachment test
+				ActorSpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+			}
+			else
+			{
+				StartLocation = FVector(FMath::RandRange(-1250.f, 1250.f), FMath::RandRange(-1250.f, 1250.f), 500.f);
+			}
 			ABallEnemy* Enemy = World->SpawnActor<ABallEnemy>(BallEnemyClass, StartLocation, FRotator::ZeroRotator, ActorSpawnParams);
 
 			FVector StartVelocity(FMath::RandRange(-1250.f, 1250.f), FMath::RandRange(-1250.f, 1250.f), FMath::RandRange(-1250.f, 1250.f));
 			Enemy->StaticMesh->SetPhysicsLinearVelocity(StartVelocity);
-
-			FTimerHandle LightsTimerHandle;
-			FTimerDelegate LightsTimerDelegate;
-			bool State = true;
-			LightsTimerDelegate.BindUFunction(this, FName("SetLightsState"), State);
 		}
 	}
 }
@@ -5,6 +5,12 @@
 #include "CoreMinimal.h"
 #include "GameFramework/GameModeBase.h"
 #include "EventDispatcher.h"
+#include "ServerReplay.h"
+#include "FuturumCollision.h"
+#include "SpawnLocationSolver.h"
+#include "MatchSnapshot.h"
+#include "FuturumPlayerController.h"
+#include "TimingWheel.h"
 #include "FuturumGameMode.generated.h"
 
 UCLASS(minimalapi)
@@ -18,8 +24,29 @@ public:
 	UPROPERTY()
 	UEventDispatcher* EventDispatcher;
 
+	virtual void InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage) override;
+
 	virtual void StartPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	virtual void Tick(float DeltaSeconds) override;
+
+	/** Adds an event to the server replay, if one is being recorded */
+	void RecordReplayEvent(EReplayEvent Type, const FVector& Location, const FRotator& Rotation);
+
+	/** Starts an async use trace on the Interactable channel, the hit is used along with the others of its frame */
+	void QueueUse(AActor* User, const FVector& Start, const FVector& End);
+
+	/**
+	 * Queues a one shot effect for the players within Futurum.CosmeticEventRadius of it. Events are
+	 * merged and sent unreliably once per frame, gameplay state must not depend on them.
+	 */
+	void SendCosmeticEvent(UParticleSystem* Particles, USoundBase* Sound, const FVector& Location);
+
+	/** Puts the match back to how it started, without reloading the map */
+	void RestartMatchInPlace();
+
 private:
 	UFUNCTION()
 	void SpawnEnemy();
@@ -27,11 +54,54 @@ private:
 	UFUNCTION()
 	void SpawnEnemyWithLights();
 
-	UFUNCTION()
 	void SetLightsState(bool State);
 
+	/** Schedules a timer the start snapshot can capture */
+	void ScheduleMatchTimer(EMatchTimer Type, float Delay);
+
+	void RunMatchTimer(EMatchTimer Type);
+
+	/** Pending match timers with the time left on each */
+	void GetMatchTimers(TArray<FMatchTimer>& OutTimers) const;
+
 	UPROPERTY(EditDefaultsOnly, Category = Projectile)
 	TSubclassOf<class ABallEnemy> BallEnemyClass;
+
+	/** Set by the RecordReplay and PlayReplay URL options */
+	FString ReplayToRecord;
+	FString ReplayToPlay;
+
+	TUniquePtr<FReplayRecorder> ReplayRecorder;
+	TUniquePtr<FReplayPlayer> ReplayPlayer;
+
+	void FlushUses();
+
+	/** Hits of finished use traces, waiting for the next flush */
+	TArray<FHitResult> ResolvedUses;
+
+	void FlushCosmeticEvents();
+
+	TArray<FCosmeticEvent> CosmeticEvents;
+
+	/** Events sent to one player, kept to reuse its memory. An RPC parameter can not live in the frame arena */
+	TArray<FCosmeticEvent> NearbyEvents;
+
+	FSpawnLocationSolver SpawnLocations;
+
+	/** Gameplay timers of the match, advanced by the game mode tick */
+	FTimingWheel Timers;
+
+	struct FScheduledMatchTimer
+	{
+		EMatchTimer Type;
+		FTimingWheelHandle Handle;
+	};
+
+	/** Match timers scheduled on the wheel, the ones that ran are dropped at the next schedule */
+	TArray<FScheduledMatchTimer> MatchTimers;
+
+	/** Taken once the match has started */
+	FMatchSnapshot StartSnapshot;
 };
 
 
@@ -0,0 +1,353 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "FuturumGameState.h"
+#include "Futurum.h"
+#include "BallEnemy.h"
+#include "DynamicLight.h"
+#include "LampField.h"
+#include "FuturumCharacter.h"
+#include "EffectPoolComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "FrameArena.h"
+#include "NetMetrics.h"
+#include "EngineUtils.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "Net/UnrealNetwork.h"
+
+DECLARE_CYCLE_STAT(TEXT("Rewind sweep"), STAT_RewindSweep, STATGROUP_Futurum);
+DECLARE_MEMORY_STAT(TEXT("Enemy position history"), STAT_EnemyPositionHistoryMemory, STATGROUP_Futurum);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Registered physics bodies"), STAT_RegisteredPhysicsBodies, STATGROUP_Futurum);
+
+static TAutoConsoleVariable<float> CVarEnemySteeringInterval(
+	TEXT("Futurum.EnemySteeringInterval"),
+	0.1f,
+	TEXT("Seconds between enemy steering updates, 0 disables steering. Every update changes the enemy velocities, so each one costs a movement correction per enemy."));
+
+AFuturumGameState::AFuturumGameState()
+	: Super()
+{
+	PrimaryActorTick.bCanEverTick = true;
+
+	EffectPool = CreateDefaultSubobject<UEffectPoolComponent>(TEXT("Effect pool"));
+}
+
+void AFuturumGameState::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// Enemies can replicate to a joining client before the game state does
+	for (TActorIterator<ABallEnemy> It(GetWorld()); It; ++It)
+	{
+		RegisterEnemy(*It);
+	}
+
+	// Physics props placed in the level, and those spawned later
+	for (TActorIterator<AActor> It(GetWorld()); It; ++It)
+	{
+		RegisterPhysicsActor(*It);
+	}
+	ActorSpawnedHandle = GetWorld()->AddOnActorSpawnedHandler(FOnActorSpawned::FDelegate::CreateUObject(this, &AFuturumGameState::RegisterPhysicsActor));
+
+	// Lights that began play before the game state
+	if (GetNetMode() != NM_DedicatedServer)
+	{
+		for (TActorIterator<ADynamicLight> It(GetWorld()); It; ++It)
+		{
+			RegisterBudgetedLight(It->Light);
+		}
+		for (TActorIterator<AFuturumCharacter> It(GetWorld()); It; ++It)
+		{
+			RegisterBudgetedLight(It->GetSpotLight());
+		}
+	}
+
+	// Level lamps exist on every machine, so every machine builds its own field
+	if (ALampField::IsEnabled())
+	{
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.Owner = this;
+		SpawnParams.ObjectFlags |= RF_Transient;
+		LampField = GetWorld()->SpawnActor<ALampField>(SpawnParams);
+		LampField->GatherLamps();
+	}
+}
+
+void AFuturumGameState::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	GetWorld()->RemoveOnActorSpawnedHandler(ActorSpawnedHandle);
+	PhysicsBodies.Reset();
+	SET_DWORD_STAT(STAT_RegisteredPhysicsBodies, 0);
+	Lamps.Reset();
+	LightBudget.Reset();
+	SceneQueries.Reset();
+	EnemyHealth.Reset(ReplicatedEnemyHealth);
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void AFuturumGameState::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(AFuturumGameState, ReplicatedEnemyHealth);
+}
+
+void AFuturumGameState::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	FFrameAllocationScope AllocationScope;
+	AllocationScope.Watch(SceneQueries);
+	AllocationScope.Watch(Steering);
+	AllocationScope.Watch(LightBudget);
+	SceneQueries.Tick(GetWorld());
+
+	if (Role == ROLE_Authority)
+	{
+		// Lamps follow the newest living enemy, Enemies is not kept in spawn order
+		const ABallEnemy* Newest = nullptr;
+		for (const ABallEnemy* Enemy : Enemies)
+		{
+			if (Enemy->CurrentHealth > 0.f && (!Newest || Enemy->GetGameTimeSinceCreation() < Newest->GetGameTimeSinceCreation()))
+			{
+				Newest = Enemy;
+			}
+		}
+		Lamps.Update(Newest ? Newest->GetActorLocation() : FVector::ZeroVector);
+
+		FlushEnemyHealth();
+		UpdateSteering(DeltaSeconds);
+		BallMovementTraffic.EndFrame(Enemies.Num());
+	}
+
+	APlayerController* LocalPlayer = GetWorld()->GetFirstPlayerController();
+	if (GetNetMode() != NM_DedicatedServer && LocalPlayer && LocalPlayer->IsLocalController())
+	{
+		FVector ViewLocation;
+		FRotator ViewRotation;
+		LocalPlayer->GetPlayerViewPoint(ViewLocation, ViewRotation);
+		LightBudget.Update(ViewLocation, ViewRotation.Vector(), DeltaSeconds);
+	}
+}
+
+void AFuturumGameState::FlushEnemyHealth()
+{
+	TFrameArray<FEnemyHealthStore::FEvent> Events;
+	TFrameArray<int32> Changed;
+	EnemyHealth.Flush(ReplicatedEnemyHealth, Events, Changed);
+	if (Changed.Num() == 0)
+	{
+		return;
+	}
+
+	// A changed fast array entry sends its replication id and its fields
+	int32 ChangedBytes = 0;
+	for (int32 Id : Changed)
+	{
+		EnemyHealth.GetEnemy(Id)->CurrentHealth = EnemyHealth.GetHealth(Id);
+		const FEnemyHealthItem& Item = ReplicatedEnemyHealth.Items[Id];
+		ChangedBytes += sizeof(Item.ReplicationID) + FNetMetrics::GetStructSize(FEnemyHealthItem::StaticStruct(), &Item, GetNetDriver());
+	}
+	FNetMetrics::Get().RecordProperty(GET_MEMBER_NAME_CHECKED(AFuturumGameState, ReplicatedEnemyHealth), this, ChangedBytes);
+
+	// Destroying an enemy spawns the next one, which only appends to the table
+	for (const FEnemyHealthStore::FEvent& Event : Events)
+	{
+		ABallEnemy* Enemy = EnemyHealth.GetEnemy(Event.Id);
+		Enemy->OnHealthChanged(EnemyHealth.GetHealth(Event.Id));
+		if (Event.Type == EEnemyHealthEvent::Destroyed)
+		{
+			Enemy->DestroyObject();
+		}
+	}
+}
+
+void AFuturumGameState::UpdateSteering(float DeltaSeconds)
+{
+	const float Interval = CVarEnemySteeringInterval.GetValueOnGameThread();
+	SteeringTime += DeltaSeconds;
+	if (Interval <= 0.f || SteeringTime < Interval)
+	{
+		return;
+	}
+
+	// Dying enemies fall and replayed ones are moved by the replay
+	TFrameArray<UStaticMeshComponent*> Agents;
+	for (ABallEnemy* Enemy : Enemies)
+	{
+		if (Enemy->CurrentHealth > 0.f && Enemy->StaticMesh->IsSimulatingPhysics())
+		{
+			Agents.Add(Enemy->StaticMesh);
+		}
+	}
+
+	Steering.Reset(Agents.Num());
+	for (int32 Index = 0; Index < Agents.Num(); ++Index)
+	{
+		Steering.SetAgent(Index, Agents[Index]->GetComponentLocation(), Agents[Index]->GetPhysicsLinearVelocity());
+	}
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APawn* Pawn = It->Get() ? It->Get()->GetPawn() : nullptr;
+		if (Pawn)
+		{
+			Steering.AddTarget(Pawn->GetActorLocation());
+		}
+	}
+
+	Steering.Update(SteeringTime);
+	SteeringTime = 0.f;
+
+	for (int32 Index = 0; Index < Agents.Num(); ++Index)
+	{
+		Agents[Index]->SetPhysicsLinearVelocity(Steering.GetVelocity(Index));
+	}
+}
+
+void AFuturumGameState::RegisterLamp(ADynamicLight* Lamp)
+{
+	Lamps.Add(Lamp);
+}
+
+void AFuturumGameState::UnregisterLamp(ADynamicLight* Lamp)
+{
+	Lamps.Remove(Lamp);
+}
+
+void AFuturumGameState::RegisterBudgetedLight(ULightComponent* Light)
+{
+	if (GetNetMode() != NM_DedicatedServer)
+	{
+		LightBudget.Register(Light);
+	}
+}
+
+void AFuturumGameState::UnregisterBudgetedLight(ULightComponent* Light)
+{
+	LightBudget.Unregister(Light);
+}
+
+void AFuturumGameState::RegisterPhysicsActor(AActor* Actor)
+{
+	UStaticMeshComponent* Body = Cast<UStaticMeshComponent>(Actor->GetRootComponent());
+	if (Body && Body->IsSimulatingPhysics() && !Actor->IsA<ABallEnemy>())
+	{
+		PhysicsBodies.Register(Body);
+		Actor->OnEndPlay.AddUniqueDynamic(this, &AFuturumGameState::OnPhysicsActorEndPlay);
+		SET_DWORD_STAT(STAT_RegisteredPhysicsBodies, PhysicsBodies.Num());
+	}
+}
+
+void AFuturumGameState::OnPhysicsActorEndPlay(AActor* Actor, EEndPlayReason::Type EndPlayReason)
+{
+	PhysicsBodies.Unregister(Cast<UStaticMeshComponent>(Actor->GetRootComponent()));
+	SET_DWORD_STAT(STAT_RegisteredPhysicsBodies, PhysicsBodies.Num());
+}
+
+void AFuturumGameState::RegisterEnemy(ABallEnemy* Enemy)
+{
+	if (!Enemies.Contains(Enemy))
+	{
+		Enemies.Add(Enemy);
+		PhysicsBodies.Register(Enemy->StaticMesh);
+		INC_MEMORY_STAT_BY(STAT_EnemyPositionHistoryMemory, sizeof(FEnemyPositionHistory));
+		SET_DWORD_STAT(STAT_RegisteredPhysicsBodies, PhysicsBodies.Num());
+
+		if (Role == ROLE_Authority)
+		{
+			Enemy->HealthId = EnemyHealth.Add(Enemy, Enemy->CurrentHealth, ReplicatedEnemyHealth);
+		}
+	}
+}
+
+void AFuturumGameState::UnregisterEnemy(ABallEnemy* Enemy)
+{
+	if (Enemies.RemoveSwap(Enemy) > 0)
+	{
+		if (Enemy->HealthId != INDEX_NONE)
+		{
+			EnemyHealth.Remove(Enemy->HealthId, ReplicatedEnemyHealth);
+			Enemy->HealthId = INDEX_NONE;
+		}
+		PhysicsBodies.Unregister(Enemy->StaticMesh);
+		SET_DWORD_STAT(STAT_RegisteredPhysicsBodies, PhysicsBodies.Num());
+		DEC_MEMORY_STAT_BY(STAT_EnemyPositionHistoryMemory, sizeof(FEnemyPositionHistory));
+	}
+}
+
+void AFuturumGameState::DamageEnemy(ABallEnemy* Enemy, float Damage)
+{
+	if (Enemy->HealthId != INDEX_NONE)
+	{
+		EnemyHealth.ApplyDamage(Enemy->HealthId, Damage);
+	}
+}
+
+void AFuturumGameState::SetEnemyHealth(ABallEnemy* Enemy, float Health)
+{
+	if (Enemy->HealthId != INDEX_NONE)
+	{
+		EnemyHealth.SetHealth(Enemy->HealthId, Health);
+	}
+}
+
+bool AFuturumGameState::GetReplicatedEnemyHealth(const ABallEnemy* Enemy, float& OutHealth) const
+{
+	for (const FEnemyHealthItem& Item : ReplicatedEnemyHealth.Items)
+	{
+		if (Item.Enemy == Enemy)
+		{
+			OutHealth = Item.Health;
+			return true;
+		}
+	}
+	return false;
+}
+
+ABallEnemy* AFuturumGameState::RewindSweep(float ShotTime, const FVector& Start, const FVector& End, FVector& OutHitLocation) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_RewindSweep);
+
+	FVector Direction;
+	float Length;
+	(End - Start).ToDirectionAndLength(Direction, Length);
+
+	ABallEnemy* ClosestEnemy = nullptr;
+	float ClosestDistance = Length;
+	FVector ClosestOffset = FVector::ZeroVector;
+
+	for (ABallEnemy* Enemy : Enemies)
+	{
+		FVector RewoundLocation;
+		if (!Enemy->PositionHistory.GetLocationAt(ShotTime, RewoundLocation))
+		{
+			continue;
+		}
+
+		// Segment against sphere
+		const FVector ToStart = Start - RewoundLocation;
+		const float B = ToStart | Direction;
+		const float C = ToStart.SizeSquared() - FMath::Square(Enemy->HitRadius);
+		const float Discriminant = B * B - C;
+		if ((C > 0.f && B > 0.f) || Discriminant < 0.f)
+		{
+			continue;
+		}
+
+		const float Distance = FMath::Max(-B - FMath::Sqrt(Discriminant), 0.f);
+		if (Distance < ClosestDistance)
+		{
+			ClosestEnemy = Enemy;
+			ClosestDistance = Distance;
+			ClosestOffset = Enemy->GetActorLocation() - RewoundLocation;
+		}
+	}
+
+	if (ClosestEnemy)
+	{
+		OutHitLocation = Start + Direction * ClosestDistance + ClosestOffset;
+	}
+	return ClosestEnemy;
+}
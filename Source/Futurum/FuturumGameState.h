@@ -0,0 +1,137 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/GameStateBase.h"
+#include "PhysicsBodyRegistry.h"
+#include "LampTable.h"
+#include "AsyncSceneQueries.h"
+#include "EnemySteering.h"
+#include "LightBudget.h"
+#include "EnemyHealth.h"
+#include "BallEnemy.h"
+#include "FuturumGameState.generated.h"
+
+class ABallEnemy;
+class ADynamicLight;
+class ALampField;
+class ULightComponent;
+class UEffectPoolComponent;
+
+/**
+ * World wide state of a Futurum match, present on the server and on every client.
+ */
+UCLASS()
+class FUTURUM_API AFuturumGameState : public AGameStateBase
+{
+	GENERATED_BODY()
+
+public:
+	AFuturumGameState();
+
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	virtual void Tick(float DeltaSeconds) override;
+
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+	void RegisterEnemy(ABallEnemy* Enemy);
+
+	void UnregisterEnemy(ABallEnemy* Enemy);
+
+	FORCEINLINE const TArray<ABallEnemy*>& GetEnemies() const { return Enemies; }
+
+	/** Damage applied with the rest at the next tick. Server only */
+	void DamageEnemy(ABallEnemy* Enemy, float Damage);
+
+	/** Server only */
+	void SetEnemyHealth(ABallEnemy* Enemy, float Health);
+
+	/** Health of the enemy as last replicated, on clients */
+	bool GetReplicatedEnemyHealth(const ABallEnemy* Enemy, float& OutHealth) const;
+
+	/** Queries answered on a later frame, polled by the game state tick */
+	FORCEINLINE FAsyncSceneQueries& GetSceneQueries() { return SceneQueries; }
+
+	/** One shot explosions on this machine */
+	FORCEINLINE UEffectPoolComponent* GetEffectPool() const { return EffectPool; }
+
+	/** Lamps are only tracked on the server, clients get their colors replicated */
+	void RegisterLamp(ADynamicLight* Lamp);
+
+	void UnregisterLamp(ADynamicLight* Lamp);
+
+	/** Dynamic lights faded in and out around the local view, not used on a dedicated server */
+	void RegisterBudgetedLight(ULightComponent* Light);
+
+	void UnregisterBudgetedLight(ULightComponent* Light);
+
+	/** What the ball movement corrections send, server only */
+	FORCEINLINE FBallMovementTraffic& GetBallMovementTraffic() { return BallMovementTraffic; }
+
+	/** Meshes pushed around by explosions */
+	FORCEINLINE const FPhysicsBodyRegistry& GetPhysicsBodies() const { return PhysicsBodies; }
+
+	FORCEINLINE void ProjectileSpawned() { ++ProjectilesInFlight; }
+
+	FORCEINLINE void ProjectileRemoved() { ProjectilesInFlight = FMath::Max(ProjectilesInFlight - 1, 0); }
+
+	FORCEINLINE int32 GetProjectilesInFlight() const { return ProjectilesInFlight; }
+
+	/**
+	 * Finds the first enemy hit by the segment, with the enemies placed where they were at ShotTime.
+	 * OutHitLocation is the impact point moved along with the enemy to where it is now. Server only.
+	 */
+	ABallEnemy* RewindSweep(float ShotTime, const FVector& Start, const FVector& End, FVector& OutHitLocation) const;
+
+private:
+	/** Applies the damage of the frame and raises the threshold events. Server only */
+	void FlushEnemyHealth();
+
+	/** Steers every living enemy towards the players in one batch. Server only */
+	void UpdateSteering(float DeltaSeconds);
+
+	/** Adds the actor's body to the registry if it is a simulated prop */
+	void RegisterPhysicsActor(AActor* Actor);
+
+	UFUNCTION()
+	void OnPhysicsActorEndPlay(AActor* Actor, EEndPlayReason::Type EndPlayReason);
+
+	/** Props spawned during the match, enemy explosions push them too */
+	FDelegateHandle ActorSpawnedHandle;
+
+	UPROPERTY()
+	TArray<ABallEnemy*> Enemies;
+
+	FEnemyHealthStore EnemyHealth;
+
+	UPROPERTY(Replicated)
+	FEnemyHealthArray ReplicatedEnemyHealth;
+
+	FPhysicsBodyRegistry PhysicsBodies;
+
+	FLampTable Lamps;
+
+	FLightBudget LightBudget;
+
+	FAsyncSceneQueries SceneQueries;
+
+	FEnemySteering Steering;
+
+	FBallMovementTraffic BallMovementTraffic;
+
+	/** Time gathered since the enemies were last steered */
+	float SteeringTime = 0.f;
+
+	UPROPERTY()
+	ALampField* LampField = nullptr;
+
+	UPROPERTY()
+	UEffectPoolComponent* EffectPool = nullptr;
+
+	/** Projectiles alive in this world, on clients only the replicated ones */
+	int32 ProjectilesInFlight = 0;
+};
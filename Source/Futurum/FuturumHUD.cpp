@@ -1,12 +1,27 @@
 // Copyright 1998-2018 Epic Games, Inc. All Rights Reserved.
 
 #include "FuturumHUD.h"
+#include "Futurum.h"
+#include "FuturumGameState.h"
 #include "Engine/Canvas.h"
+#include "Engine/Engine.h"
+#include "Engine/NetDriver.h"
+#include "Engine/NetConnection.h"
 #include "Engine/Texture2D.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/App.h"
 #include "TextureResource.h"
-#include "CanvasItem.h"
 #include "UObject/ConstructorHelpers.h"
 
+DECLARE_CYCLE_STAT(TEXT("Draw HUD"), STAT_DrawHUD, STATGROUP_Futurum);
+DECLARE_DWORD_COUNTER_STAT(TEXT("HUD draw items"), STAT_HUDDrawItems, STATGROUP_Futurum);
+
+static TAutoConsoleVariable<int32> CVarShowPerfHUD(
+	TEXT("Futurum.ShowPerfHUD"),
+	0,
+	TEXT("Shows frame time, enemy count, projectiles in flight and replication rate on the HUD."));
+
 AFuturumHUD::AFuturumHUD()
 {
 	// Set the crosshair texture
@@ -17,10 +32,34 @@ AFuturumHUD::AFuturumHUD()
 
 void AFuturumHUD::DrawHUD()
 {
+	SCOPE_CYCLE_COUNTER(STAT_DrawHUD);
+
 	Super::DrawHUD();
 
-	// Draw very simple crosshair
+	const FIntPoint ViewportSize(FMath::TruncToInt(Canvas->ClipX), FMath::TruncToInt(Canvas->ClipY));
+	if (ViewportSize != CachedViewportSize || !CrosshairItem.IsValid())
+	{
+		CachedViewportSize = ViewportSize;
+		BuildStaticItems();
+	}
+
+	// draw the crosshair
+	DrawHUDItem(*CrosshairItem);
 
+	if (CVarShowPerfHUD.GetValueOnGameThread() != 0)
+	{
+		SmoothedFrameTime = FMath::Lerp(SmoothedFrameTime, (float)FApp::GetDeltaTime(), 0.1f);
+		if (FApp::GetCurrentTime() >= NextPerfUpdateTime)
+		{
+			NextPerfUpdateTime = FApp::GetCurrentTime() + PerfUpdateInterval;
+			UpdatePerfText();
+		}
+		DrawHUDItem(*PerfItem);
+	}
+}
+
+void AFuturumHUD::BuildStaticItems()
+{
 	// find center of the Canvas
 	const FVector2D Center(Canvas->ClipX * 0.5f, Canvas->ClipY * 0.5f);
 
@@ -28,8 +67,43 @@ void AFuturumHUD::DrawHUD()
 	const FVector2D CrosshairDrawPosition( (Center.X),
 										   (Center.Y + 20.0f));
 
-	// draw the crosshair
-	FCanvasTileItem TileItem( CrosshairDrawPosition, CrosshairTex->Resource, FLinearColor::White);
-	TileItem.BlendMode = SE_BLEND_Translucent;
-	Canvas->DrawItem( TileItem );
+	CrosshairItem = MakeUnique<FCanvasTileItem>(CrosshairDrawPosition, CrosshairTex->Resource, FLinearColor::White);
+	CrosshairItem->BlendMode = SE_BLEND_Translucent;
+
+	if (!PerfItem.IsValid())
+	{
+		PerfItem = MakeUnique<FCanvasTextItem>(FVector2D(16.f, 16.f), FText::GetEmpty(), GEngine->GetSmallFont(), FLinearColor::Green);
+		PerfItem->EnableShadow(FLinearColor::Black);
+	}
+}
+
+void AFuturumHUD::UpdatePerfText()
+{
+	const AFuturumGameState* GameState = GetWorld()->GetGameState<AFuturumGameState>();
+	const int32 NumEnemies = GameState ? GameState->GetEnemies().Num() : 0;
+	const int32 NumProjectiles = GameState ? GameState->GetProjectilesInFlight() : 0;
+
+	// Incoming rate on a client, outgoing rate summed over the connections on a listen server
+	int32 BytesPerSecond = 0;
+	const UNetDriver* NetDriver = GetWorld()->GetNetDriver();
+	if (NetDriver && NetDriver->ServerConnection)
+	{
+		BytesPerSecond = NetDriver->ServerConnection->InBytesPerSecond;
+	}
+	else if (NetDriver)
+	{
+		for (const UNetConnection* Connection : NetDriver->ClientConnections)
+		{
+			BytesPerSecond += Connection->OutBytesPerSecond;
+		}
+	}
+
+	PerfItem->Text = FText::FromString(FString::Printf(TEXT("Frame %.2f ms\nEnemies %d\nProjectiles %d\nReplication %.1f KB/s"),
+		SmoothedFrameTime * 1000.f, NumEnemies, NumProjectiles, BytesPerSecond / 1024.f));
+}
+
+void AFuturumHUD::DrawHUDItem(FCanvasItem& Item)
+{
+	INC_DWORD_STAT(STAT_HUDDrawItems);
+	Canvas->DrawItem(Item);
 }
@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/HUD.h"
+#include "CanvasItem.h"
 #include "FuturumHUD.generated.h"
 
 UCLASS()
@@ -18,8 +19,32 @@ public:
 	virtual void DrawHUD() override;
 
 private:
+	/** Rebuilds the retained items, only needed when the viewport changes size */
+	void BuildStaticItems();
+
+	/** Refreshes the perf overlay text from the module stats */
+	void UpdatePerfText();
+
+	/** Draws an item and counts it for the HUD draw stat */
+	void DrawHUDItem(FCanvasItem& Item);
+
 	/** Crosshair asset pointer */
 	class UTexture2D* CrosshairTex;
 
-};
+	/** Retained crosshair, positioned for CachedViewportSize */
+	TUniquePtr<FCanvasTileItem> CrosshairItem;
+
+	/** Retained perf overlay, all widgets share one text item */
+	TUniquePtr<FCanvasTextItem> PerfItem;
 
+	FIntPoint CachedViewportSize = FIntPoint::ZeroValue;
+
+	/** Real time at which the perf overlay text is rebuilt next */
+	double NextPerfUpdateTime = 0.0;
+
+	float SmoothedFrameTime = 0.f;
+
+	/** How often the perf overlay text is rebuilt, in seconds */
+	UPROPERTY(EditDefaultsOnly, Category = HUD)
+	float PerfUpdateInterval = 0.25f;
+};
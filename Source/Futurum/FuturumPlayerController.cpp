@@ -0,0 +1,20 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "FuturumPlayerController.h"
+#include "FuturumGameState.h"
+#include "EffectPoolComponent.h"
+#include "Engine/World.h"
+
+void AFuturumPlayerController::ClientCosmeticEvents_Implementation(const TArray<FCosmeticEvent>& Events)
+{
+	AFuturumGameState* GameState = GetWorld()->GetGameState<AFuturumGameState>();
+	if (!GameState)
+	{
+		return;
+	}
+
+	for (const FCosmeticEvent& Event : Events)
+	{
+		GameState->GetEffectPool()->SpawnEffect(Event.Particles, Event.Sound, Event.Location);
+	}
+}
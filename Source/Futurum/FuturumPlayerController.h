@@ -0,0 +1,38 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/PlayerController.h"
+#include "Engine/NetSerialization.h"
+#include "FuturumPlayerController.generated.h"
+
+class UParticleSystem;
+class USoundBase;
+
+/** One shot effect sent by the server, the game state it belongs to is replicated on its own */
+USTRUCT()
+struct FCosmeticEvent
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	UParticleSystem* Particles = nullptr;
+
+	UPROPERTY()
+	USoundBase* Sound = nullptr;
+
+	UPROPERTY()
+	FVector_NetQuantize Location;
+};
+
+UCLASS()
+class FUTURUM_API AFuturumPlayerController : public APlayerController
+{
+	GENERATED_BODY()
+
+public:
+	/** Effects of one server frame near this player, may be dropped */
+	UFUNCTION(Client, Unreliable)
+	void ClientCosmeticEvents(const TArray<FCosmeticEvent>& Events);
+};
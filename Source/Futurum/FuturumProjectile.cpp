@@ -1,6 +1,13 @@
 // Copyright 1998-2018 Epic Games, Inc. All Rights Reserved.
 
 #include "FuturumProjectile.h"
+#include "Futurum.h"
+#include "FuturumGameState.h"
+#include "FrameArena.h"
+#include "EffectPoolComponent.h"
+#include "FuturumGameMode.h"
+#include "FuturumCollision.h"
+#include "FuturumCharacter.h"
 #include "GameFramework/ProjectileMovementComponent.h"
 #include "Components/SphereComponent.h"
 #include "Interactable.h"
@@ -10,13 +17,17 @@
 #include "Engine/Classes/Kismet/GameplayStatics.h"
 #include "Engine/World.h"
 #include "Components/StaticMeshComponent.h"
+#include "GameFramework/DamageType.h"
+#include "Net/UnrealNetwork.h"
+
+DECLARE_CYCLE_STAT(TEXT("Projectile explosion impulse"), STAT_ProjectileExplosionImpulse, STATGROUP_Futurum);
 
 AFuturumProjectile::AFuturumProjectile() 
 {
 	// Use a sphere as a simple collision representation
 	CollisionComp = CreateDefaultSubobject<USphereComponent>(TEXT("SphereComp"));
 	CollisionComp->InitSphereRadius(1.0f);
-	CollisionComp->BodyInstance.SetCollisionProfileName("Projectile");
+	CollisionComp->BodyInstance.SetCollisionProfileName(FuturumCollision::ProjectileProfile);
 	CollisionComp->OnComponentHit.AddDynamic(this, &AFuturumProjectile::OnHit);		// set up a notification for when this component hits something blocking
 
 	// Players can't walk on it
@@ -63,43 +74,187 @@ AFuturumProjectile::AFuturumProjectile()
 	SetReplicates(true);
 }
 
+void AFuturumProjectile::BeginPlay()
+{
+	Super::BeginPlay();
+
+	AFuturumGameState* GameState = GetWorld()->GetGameState<AFuturumGameState>();
+	if (GameState && !bPredicted)
+	{
+		GameState->ProjectileSpawned();
+	}
+
+	// The shooter's client may already show this shot
+	AFuturumCharacter* Shooter = Cast<AFuturumCharacter>(GetOwner());
+	if (Role < ROLE_Authority && ShotSequence != 0 && Shooter && Shooter->IsLocallyControlled())
+	{
+		Shooter->ConfirmShot(this);
+	}
+
+	AFuturumGameMode* GameMode = GetWorld()->GetAuthGameMode<AFuturumGameMode>();
+	if (GameMode)
+	{
+		GameMode->RecordReplayEvent(EReplayEvent::ProjectileSpawned, GetActorLocation(), GetActorRotation());
+	}
+}
+
+void AFuturumProjectile::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	AFuturumGameState* GameState = GetWorld()->GetGameState<AFuturumGameState>();
+	if (GameState && !bPredicted)
+	{
+		GameState->ProjectileRemoved();
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void AFuturumProjectile::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME_CONDITION(AFuturumProjectile, ShotSequence, COND_InitialOnly);
+}
+
+void AFuturumProjectile::SuppressEffects()
+{
+	bEffectsSuppressed = true;
+	Mesh->SetVisibility(false);
+}
+
 void AFuturumProjectile::OnHit(UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit)
 {
 	// Only add impulse and destroy projectile if we hit a physics
 
 	if ((OtherActor != NULL) && (OtherActor != this) && (OtherComp != NULL))
 	{
-		TArray<AActor*> IgnoreActors;
-		if (Role == ROLE_Authority)
+		AFuturumGameState* GameState = GetWorld()->GetGameState<AFuturumGameState>();
+		if (Role == ROLE_Authority && !bPredicted)
 		{
-			UGameplayStatics::ApplyRadialDamage(this, 10.f, GetActorLocation(), ExplosionRadius, DamageType, IgnoreActors, this, nullptr, false, ECollisionChannel::ECC_Visibility);
-
-			TArray<FOverlapResult> Overlaps;
-			FCollisionObjectQueryParams QueryParams;
-			QueryParams.AddObjectTypesToQuery(ECC_WorldDynamic);
-			QueryParams.AddObjectTypesToQuery(ECC_PhysicsBody);
-			QueryParams.AddObjectTypesToQuery(ECC_GameTraceChannel2);
-
-			FCollisionShape ExplosionShape;
-			ExplosionShape.SetSphere(ExplosionRadius);
-			GetWorld()->OverlapMultiByObjectType(Overlaps, GetActorLocation(), FQuat::Identity, QueryParams, ExplosionShape);
+			AFuturumGameMode* GameMode = GetWorld()->GetAuthGameMode<AFuturumGameMode>();
+			if (GameMode)
+			{
+				GameMode->RecordReplayEvent(EReplayEvent::ProjectileHit, GetActorLocation(), GetActorRotation());
+			}
 
-			for (FOverlapResult Hit : Overlaps)
+			if (GameState)
 			{
-				UStaticMeshComponent* MeshComponent = Cast<UStaticMeshComponent>((Hit.GetActor())->GetRootComponent());
+				ApplyExplosionDamage(GameState);
+
+				SCOPE_CYCLE_COUNTER(STAT_ProjectileExplosionImpulse);
 
-				if (MeshComponent)
+				TFrameArray<UStaticMeshComponent*> Bodies;
+				GameState->GetPhysicsBodies().GatherBodies(GetActorLocation(), ExplosionRadius, Bodies);
+				for (UStaticMeshComponent* Body : Bodies)
 				{
-					MeshComponent->AddRadialImpulse(GetActorLocation(), ExplosionRadius, 90000.f, ERadialImpulseFalloff::RIF_Linear);
+					Body->AddRadialImpulse(GetActorLocation(), ExplosionRadius, 90000.f, ERadialImpulseFalloff::RIF_Linear);
 				}
 			}
 		}
-		UGameplayStatics::SpawnEmitterAtLocation(GetWorld(), Explosion, GetActorLocation());
-		UGameplayStatics::SpawnSoundAtLocation(GetWorld(), ExplosionSound, GetActorLocation(), FRotator::ZeroRotator, 2.0f);
+		if (GameState && !bEffectsSuppressed)
+		{
+			GameState->GetEffectPool()->SpawnEffect(Explosion, ExplosionSound, GetActorLocation(), 2.0f);
+		}
 
 		Destroy();
 	}
 
 
 
-}
\ No newline at end of file
+}
+
+void AFuturumProjectile::ApplyExplosionDamage(AFuturumGameState* GameState)
+{
+	// Shared by the queries of one explosion, damage is dealt once the cover traces are back
+	struct FExplosion
+	{
+		FRadialDamageEvent DamageEvent;
+		TWeakObjectPtr<AActor> DamageCauser;
+
+		/** Component in reach of the explosion, by cover trace */
+		struct FTarget
+		{
+			TWeakObjectPtr<AActor> Victim;
+			TWeakObjectPtr<UPrimitiveComponent> Component;
+			FVector Location;
+			int32 Item;
+		};
+		TArray<FTarget> Targets;
+
+		void ApplyDamage(const TArray<FHitResult>& CoverHits)
+		{
+			TMap<TWeakObjectPtr<AActor>, TArray<FHitResult>> VictimHits;
+			for (int32 Index = 0; Index < Targets.Num(); ++Index)
+			{
+				const FTarget& Target = Targets[Index];
+				const FHitResult& CoverHit = CoverHits[Index];
+				if (Target.Victim.IsValid() && Target.Component.IsValid() && (!CoverHit.bBlockingHit || CoverHit.Component == Target.Component))
+				{
+					FHitResult Hit(Target.Victim.Get(), Target.Component.Get(), Target.Location, (DamageEvent.Origin - Target.Location).GetSafeNormal());
+					Hit.Item = Target.Item;
+					VictimHits.FindOrAdd(Target.Victim).Add(Hit);
+				}
+			}
+
+			for (TPair<TWeakObjectPtr<AActor>, TArray<FHitResult>>& Victim : VictimHits)
+			{
+				if (Victim.Key.IsValid())
+				{
+					DamageEvent.ComponentHits = Victim.Value;
+					Victim.Key->TakeDamage(DamageEvent.Params.BaseDamage, DamageEvent, nullptr, DamageCauser.Get());
+				}
+			}
+		}
+	};
+
+	TSharedRef<FExplosion> Explosion = MakeShared<FExplosion>();
+	Explosion->DamageEvent.DamageTypeClass = DamageType ? *DamageType : UDamageType::StaticClass();
+	Explosion->DamageEvent.Origin = GetActorLocation();
+	Explosion->DamageEvent.Params = FRadialDamageParams(10.f, 0.f, 0.f, ExplosionRadius, 1.f);
+	Explosion->DamageCauser = this;
+
+	UWorld* World = GetWorld();
+	static const FCollisionObjectQueryParams ObjectParams(FCollisionObjectQueryParams::AllDynamicObjects);
+	static const FCollisionQueryParams OverlapParams(SCENE_QUERY_STAT(ExplosionOverlap), false);
+	static const FCollisionQueryParams CoverParams(SCENE_QUERY_STAT(ExplosionCover), false);
+
+	// Owned by the game state, the projectile itself is destroyed right after the hit
+	auto FindTargets = [World, GameState, Explosion](const TArray<FOverlapResult>& Overlaps)
+	{
+		FLineTraceBatch CoverTraces;
+		for (const FOverlapResult& Overlap : Overlaps)
+		{
+			AActor* Victim = Overlap.GetActor();
+			UPrimitiveComponent* Component = Overlap.GetComponent();
+			if (!Victim || !Component || !Victim->bCanBeDamaged || Victim == Explosion->DamageCauser.Get())
+			{
+				continue;
+			}
+
+			// Same cover test as the engine radial damage, a trace to the middle of the component
+			FExplosion::FTarget Target;
+			Target.Victim = Victim;
+			Target.Component = Component;
+			Target.Location = Component->Bounds.Origin;
+			Target.Item = Overlap.ItemIndex;
+			Explosion->Targets.Add(Target);
+			CoverTraces.Add(Explosion->DamageEvent.Origin, Target.Location);
+		}
+
+		CoverTraces.Run(World, GameState->GetSceneQueries(), GameState, ECC_Visibility, CoverParams, [Explosion](const TArray<FHitResult>& CoverHits)
+		{
+			Explosion->ApplyDamage(CoverHits);
+		});
+	};
+
+	// A lost overlap is run again blocking, the explosion still deals its damage
+	const FVector Location = GetActorLocation();
+	const FCollisionShape Sphere = FCollisionShape::MakeSphere(ExplosionRadius);
+	GameState->GetSceneQueries().Overlap(World, GameState, Location, Sphere, ObjectParams, OverlapParams, FindTargets,
+		[World, Location, Sphere, FindTargets]()
+		{
+			TArray<FOverlapResult> Overlaps;
+			World->OverlapMultiByObjectType(Overlaps, Location, FQuat::Identity, ObjectParams, Sphere, OverlapParams);
+			FindTargets(Overlaps);
+		});
+}
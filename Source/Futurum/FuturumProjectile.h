@@ -31,13 +31,29 @@ class AFuturumProjectile : public AActor
 	UPROPERTY(EditAnywhere)
 	float ExplosionRadius = 400.f;
 
+	bool bEffectsSuppressed = false;
+
 public:
 	AFuturumProjectile();
 
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	/** called when projectile hits something */
 	UFUNCTION()
 	void OnHit(UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit);
 
+	/** Fire command of the owning client this projectile was spawned for, 0 if it was fired on the server */
+	UPROPERTY(Replicated)
+	uint16 ShotSequence = 0;
+
+	/** Spawned by the owning client ahead of the server, only for show. Set before BeginPlay */
+	bool bPredicted = false;
+
+	/** Hides the projectile and its explosion, for when the predicted one already showed them */
+	void SuppressEffects();
+
 	/** Returns CollisionComp subobject **/
 	FORCEINLINE class USphereComponent* GetCollisionComp() const { return CollisionComp; }
 	/** Returns ProjectileMovement subobject **/
@@ -46,5 +62,9 @@ public:
 protected:
 	UPROPERTY(EditDefaultsOnly)
 	TSubclassOf<class UDamageType> DamageType;
+
+private:
+	/** Radial damage like ApplyRadialDamage, found and checked for cover with async queries */
+	void ApplyExplosionDamage(class AFuturumGameState* GameState);
 };
 
@@ -0,0 +1,150 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "GarbageCollectionStats.h"
+#include "Futurum.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/UObjectIterator.h"
+#include "UObject/Package.h"
+#include "UObject/UObjectArray.h"
+#include "DynamicLight.h"
+
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Last GC pause (ms)"), STAT_LastGarbageCollectPause, STATGROUP_Futurum);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Garbage collections"), STAT_GarbageCollections, STATGROUP_Futurum);
+
+static FAutoConsoleCommand GCReportCommand(
+	TEXT("Futurum.GCReport"),
+	TEXT("Logs the object count of every game class, the GC cluster count and the garbage collection pause percentiles."),
+	FConsoleCommandDelegate::CreateLambda([]()
+	{
+		FGarbageCollectionStats::Get().Report();
+	}));
+
+static FAutoConsoleCommand GCSoakCommand(
+	TEXT("Futurum.GCSoak"),
+	TEXT("Restarts the garbage collection samples and reports them after the given number of seconds, one hour by default."),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		FGarbageCollectionStats::Get().StartSoak(Args.Num() > 0 ? FCString::Atof(*Args[0]) : 3600.f);
+	}));
+
+namespace
+{
+	float GetPercentile(const TArray<float>& SortedValues, float Percentile)
+	{
+		if (SortedValues.Num() == 0)
+		{
+			return 0.f;
+		}
+		const int32 Index = FMath::Clamp(FMath::CeilToInt(Percentile * SortedValues.Num()) - 1, 0, SortedValues.Num() - 1);
+		return SortedValues[Index];
+	}
+}
+
+FGarbageCollectionStats& FGarbageCollectionStats::Get()
+{
+	static FGarbageCollectionStats Stats;
+	return Stats;
+}
+
+void FGarbageCollectionStats::Startup()
+{
+	PreGarbageCollectHandle = FCoreUObjectDelegates::GetPreGarbageCollectDelegate().AddRaw(this, &FGarbageCollectionStats::OnPreGarbageCollect);
+	PostGarbageCollectHandle = FCoreUObjectDelegates::GetPostGarbageCollect().AddRaw(this, &FGarbageCollectionStats::OnPostGarbageCollect);
+	SampleStartTime = FPlatformTime::Seconds();
+}
+
+void FGarbageCollectionStats::Shutdown()
+{
+	FCoreUObjectDelegates::GetPreGarbageCollectDelegate().Remove(PreGarbageCollectHandle);
+	FCoreUObjectDelegates::GetPostGarbageCollect().Remove(PostGarbageCollectHandle);
+	if (SoakTickerHandle.IsValid())
+	{
+		FTicker::GetCoreTicker().RemoveTicker(SoakTickerHandle);
+		SoakTickerHandle.Reset();
+	}
+}
+
+void FGarbageCollectionStats::StartSoak(float Duration)
+{
+	Pauses.Reset();
+	SampleStartTime = FPlatformTime::Seconds();
+	SoakEndTime = SampleStartTime + Duration;
+	if (!SoakTickerHandle.IsValid())
+	{
+		SoakTickerHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FGarbageCollectionStats::TickSoak), 1.f);
+	}
+	UE_LOG(LogFuturum, Log, TEXT("GC soak started for %.0f s"), Duration);
+}
+
+bool FGarbageCollectionStats::TickSoak(float DeltaTime)
+{
+	if (FPlatformTime::Seconds() < SoakEndTime)
+	{
+		return true;
+	}
+
+	UE_LOG(LogFuturum, Log, TEXT("GC soak finished"));
+	Report();
+	SoakTickerHandle.Reset();
+	return false;
+}
+
+void FGarbageCollectionStats::OnPreGarbageCollect()
+{
+	CollectStartTime = FPlatformTime::Seconds();
+}
+
+void FGarbageCollectionStats::OnPostGarbageCollect()
+{
+	const float Pause = (FPlatformTime::Seconds() - CollectStartTime) * 1000.0;
+	Pauses.Add(Pause);
+	SET_FLOAT_STAT(STAT_LastGarbageCollectPause, Pause);
+	INC_DWORD_STAT(STAT_GarbageCollections);
+}
+
+void FGarbageCollectionStats::Report() const
+{
+	// Objects of the classes declared by this module, subobjects included
+	const UPackage* ModulePackage = FindPackage(nullptr, TEXT("/Script/Futurum"));
+	TMap<const UClass*, int32> ObjectCounts;
+	int32 TotalObjects = 0;
+	for (TObjectIterator<UObject> It; It; ++It)
+	{
+		++TotalObjects;
+		for (const UClass* Class = It->GetClass(); Class; Class = Class->GetSuperClass())
+		{
+			if (Class->GetOutermost() == ModulePackage)
+			{
+				++ObjectCounts.FindOrAdd(Class);
+				break;
+			}
+		}
+	}
+
+	UE_LOG(LogFuturum, Log, TEXT("UObjects: %d"), TotalObjects);
+
+	// Lamps are clustered with their level when the lamp field is off
+	int32 Lamps = 0;
+	int32 ClusteredLamps = 0;
+	for (TObjectIterator<ADynamicLight> It; It; ++It)
+	{
+		++Lamps;
+		if (GUObjectArray.ObjectToObjectItem(*It)->GetOwnerIndex() != 0 || It->HasAnyInternalFlags(EInternalObjectFlags::ClusterRoot))
+		{
+			++ClusteredLamps;
+		}
+	}
+	UE_LOG(LogFuturum, Log, TEXT("GC clusters: %d, lamps in a cluster: %d of %d"), GUObjectClusters.GetNumAllocatedClusters(), ClusteredLamps, Lamps);
+	for (const TPair<const UClass*, int32>& Count : ObjectCounts)
+	{
+		UE_LOG(LogFuturum, Log, TEXT("  %s: %d"), *Count.Key->GetName(), Count.Value);
+	}
+
+	TArray<float> SortedPauses = Pauses;
+	SortedPauses.Sort();
+	const double Elapsed = FPlatformTime::Seconds() - SampleStartTime;
+	UE_LOG(LogFuturum, Log, TEXT("GC: %d collections in %.0f s, pause p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms"),
+		SortedPauses.Num(), Elapsed,
+		GetPercentile(SortedPauses, 0.5f), GetPercentile(SortedPauses, 0.9f), GetPercentile(SortedPauses, 0.99f),
+		SortedPauses.Num() > 0 ? SortedPauses.Last() : 0.f);
+}
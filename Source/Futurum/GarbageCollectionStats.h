@@ -0,0 +1,45 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+
+/**
+ * Times every garbage collection and counts the objects of the game classes.
+ * Futurum.GCReport logs the counts and the pause percentiles so far,
+ * Futurum.GCSoak [Seconds] starts a fresh sample set and reports once it runs out.
+ */
+class FUTURUM_API FGarbageCollectionStats
+{
+public:
+	static FGarbageCollectionStats& Get();
+
+	/** Hooks the collector delegates, called by the module */
+	void Startup();
+
+	void Shutdown();
+
+	void StartSoak(float Duration);
+
+	void Report() const;
+
+private:
+	void OnPreGarbageCollect();
+
+	void OnPostGarbageCollect();
+
+	bool TickSoak(float DeltaTime);
+
+	double CollectStartTime = 0.0;
+
+	/** Pause of every collection since the sample set began, in milliseconds */
+	TArray<float> Pauses;
+
+	double SampleStartTime = 0.0;
+	double SoakEndTime = 0.0;
+
+	FDelegateHandle PreGarbageCollectHandle;
+	FDelegateHandle PostGarbageCollectHandle;
+	FDelegateHandle SoakTickerHandle;
+};
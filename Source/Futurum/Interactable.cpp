@@ -7,4 +7,9 @@
 void IInteractable::Use()
 {
 	return;
-}
\ No newline at end of file
+}
+
+void IInteractable::UseItem(int32 Item)
+{
+	Use();
+}
@@ -21,5 +21,8 @@ class FUTURUM_API IInteractable
 public:
 	UFUNCTION()
 	virtual void Use();
+
+	/** Use on a single instance of an instanced component, Item being the instance index of the trace hit */
+	virtual void UseItem(int32 Item);
 	
 };
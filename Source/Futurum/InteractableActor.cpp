@@ -0,0 +1,10 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "InteractableActor.h"
+
+void AInteractableActor::PostInitializeComponents()
+{
+	Super::PostInitializeComponents();
+
+	InteractableType = FInteractableDispatch::GetType(this);
+}
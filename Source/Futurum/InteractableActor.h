@@ -0,0 +1,26 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "InteractableDispatch.h"
+#include "InteractableActor.generated.h"
+
+/**
+ * Base of every actor the use trace can act on. The interactable type is resolved once
+ * when the actor registers its components and kept on the actor, so a use only costs a cast.
+ */
+UCLASS(Abstract)
+class FUTURUM_API AInteractableActor : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	virtual void PostInitializeComponents() override;
+
+	EInteractableType GetInteractableType() const { return InteractableType; }
+
+private:
+	EInteractableType InteractableType = EInteractableType::None;
+};
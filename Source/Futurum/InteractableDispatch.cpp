@@ -0,0 +1,158 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "InteractableDispatch.h"
+#include "Futurum.h"
+#include "DynamicLight.h"
+#include "LampField.h"
+#include "Interactable.h"
+#include "InteractableActor.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "HAL/IConsoleManager.h"
+
+namespace
+{
+	template<typename T>
+	struct TInteractableType;
+
+	template<>
+	struct TInteractableType<ADynamicLight>
+	{
+		static const EInteractableType Type = EInteractableType::DynamicLight;
+
+		static void Use(ADynamicLight* Lamp, int32 Item)
+		{
+			Lamp->ADynamicLight::Use();
+		}
+	};
+
+	template<>
+	struct TInteractableType<ALampField>
+	{
+		static const EInteractableType Type = EInteractableType::LampField;
+
+		static void Use(ALampField* Field, int32 Item)
+		{
+			Field->ALampField::UseItem(Item);
+		}
+	};
+
+	typedef void (*FUseFunction)(AActor* Actor, int32 Item);
+
+	template<typename T>
+	void UseAs(AActor* Actor, int32 Item)
+	{
+		TInteractableType<T>::Use(static_cast<T*>(Actor), Item);
+	}
+
+	const FUseFunction UseFunctions[] =
+	{
+		nullptr,
+		&UseAs<ADynamicLight>,
+		&UseAs<ALampField>
+	};
+	static_assert(ARRAY_COUNT(UseFunctions) == (int32)EInteractableType::Num, "Every interactable type needs a use function");
+
+	/** Interactable type of every class met so far, subclasses included */
+	TMap<const UClass*, EInteractableType>& GetClassTypes()
+	{
+		static TMap<const UClass*, EInteractableType> ClassTypes;
+		if (ClassTypes.Num() == 0)
+		{
+			ClassTypes.Add(ADynamicLight::StaticClass(), TInteractableType<ADynamicLight>::Type);
+			ClassTypes.Add(ALampField::StaticClass(), TInteractableType<ALampField>::Type);
+		}
+		return ClassTypes;
+	}
+
+	void BenchmarkDispatch(const TArray<FString>& Args, UWorld* World)
+	{
+		const int32 Iterations = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 100000;
+
+		TArray<AActor*> Actors;
+		for (TActorIterator<AActor> It(World); It; ++It)
+		{
+			if (FInteractableDispatch::GetCachedType(*It) != EInteractableType::None)
+			{
+				Actors.Add(*It);
+			}
+		}
+		if (Actors.Num() == 0)
+		{
+			return;
+		}
+
+		// Resolution only, using would toggle the lamps
+		int32 Found = 0;
+		double Start = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+		{
+			AActor* Actor = Actors[Iteration % Actors.Num()];
+			Found += Actor->GetClass()->ImplementsInterface(UInteractable::StaticClass()) && Cast<IInteractable>(Actor) != nullptr;
+		}
+		const double InterfaceTime = FPlatformTime::Seconds() - Start;
+
+		Start = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+		{
+			AActor* Actor = Actors[Iteration % Actors.Num()];
+			Found += UseFunctions[(int32)FInteractableDispatch::GetCachedType(Actor)] != nullptr;
+		}
+		const double TableTime = FPlatformTime::Seconds() - Start;
+
+		UE_LOG(LogFuturum, Log, TEXT("Interactable dispatch over %d actors, %d lookups: interface cast %.3f ms, type table %.3f ms (%d)"),
+			Actors.Num(), Iterations, InterfaceTime * 1000.0, TableTime * 1000.0, Found);
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs BenchmarkDispatchCommand(
+	TEXT("Futurum.BenchInteractableDispatch"),
+	TEXT("Times the interface cast against the interactable type table over the interactables of the world. Takes the number of lookups."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchmarkDispatch));
+
+EInteractableType FInteractableDispatch::GetType(const AActor* Actor)
+{
+	if (!Actor)
+	{
+		return EInteractableType::None;
+	}
+
+	TMap<const UClass*, EInteractableType>& ClassTypes = GetClassTypes();
+	const UClass* ActorClass = Actor->GetClass();
+	const EInteractableType* KnownType = ClassTypes.Find(ActorClass);
+	if (KnownType)
+	{
+		return *KnownType;
+	}
+
+	EInteractableType Type = EInteractableType::None;
+	for (const UClass* Class = ActorClass->GetSuperClass(); Class; Class = Class->GetSuperClass())
+	{
+		KnownType = ClassTypes.Find(Class);
+		if (KnownType)
+		{
+			Type = *KnownType;
+			break;
+		}
+	}
+	// Blueprint classes come and go, only native ones are remembered
+	if (ActorClass->HasAnyClassFlags(CLASS_Native))
+	{
+		ClassTypes.Add(ActorClass, Type);
+	}
+	return Type;
+}
+
+EInteractableType FInteractableDispatch::GetCachedType(const AActor* Actor)
+{
+	const AInteractableActor* Interactable = Cast<AInteractableActor>(Actor);
+	return Interactable ? Interactable->GetInteractableType() : EInteractableType::None;
+}
+
+void FInteractableDispatch::Use(EInteractableType Type, AActor* Actor, int32 Item)
+{
+	if (Type != EInteractableType::None && Type < EInteractableType::Num)
+	{
+		UseFunctions[(int32)Type](Actor, Item);
+	}
+}
@@ -0,0 +1,32 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class AActor;
+
+/** Every class the use trace can act on, new interactables are added here and in the table of InteractableDispatch.cpp */
+enum class EInteractableType : uint8
+{
+	None,
+	DynamicLight,
+	LampField,
+	Num
+};
+
+/**
+ * Use without going through the interface: the type of an actor is looked up once per class
+ * and kept on the actor when it registers, then every use is a call through a table of
+ * functions known at compile time.
+ */
+namespace FInteractableDispatch
+{
+	/** Resolves the type from the class of the actor, done once per actor by AInteractableActor */
+	FUTURUM_API EInteractableType GetType(const AActor* Actor);
+
+	/** Type kept on the actor, None for anything that is not an interactable */
+	FUTURUM_API EInteractableType GetCachedType(const AActor* Actor);
+
+	FUTURUM_API void Use(EInteractableType Type, AActor* Actor, int32 Item);
+}
@@ -0,0 +1,131 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "LampField.h"
+#include "Futurum.h"
+#include "DynamicLight.h"
+#include "FuturumCollision.h"
+#include "Engine/World.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/EngineTypes.h"
+#include "EngineUtils.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/UObjectArray.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Lamp instances"), STAT_LampInstances, STATGROUP_Futurum);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Lamp components removed"), STAT_LampComponentsRemoved, STATGROUP_Futurum);
+DECLARE_MEMORY_STAT(TEXT("Lamp component memory saved"), STAT_LampComponentMemorySaved, STATGROUP_Futurum);
+
+static TAutoConsoleVariable<int32> CVarInstancedLamps(
+	TEXT("Futurum.InstancedLamps"),
+	1,
+	TEXT("Draws all lamp meshes with one instanced component. Read when a level loads and when the match begins."));
+
+namespace
+{
+	SIZE_T GetComponentSize(UPrimitiveComponent* Component)
+	{
+		return Component->GetClass()->GetStructureSize() + Component->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+	}
+}
+
+ALampField::ALampField()
+{
+	PrimaryActorTick.bCanEverTick = false;
+
+	Instances = CreateDefaultSubobject<UInstancedStaticMeshComponent>(TEXT("Instances"));
+	RootComponent = Instances;
+	Instances->SetMobility(EComponentMobility::Stationary);
+	Instances->SetCollisionEnabled(ECollisionEnabled::QueryOnly);
+	Instances->SetCollisionProfileName(FuturumCollision::InteractableProfile);
+}
+
+bool ALampField::IsEnabled()
+{
+	return CVarInstancedLamps.GetValueOnAnyThread() != 0;
+}
+
+void ALampField::GatherLamps()
+{
+	int32 ComponentsRemoved = 0;
+	SIZE_T BytesSaved = 0;
+
+	for (TActorIterator<ADynamicLight> It(GetWorld()); It; ++It)
+	{
+		ADynamicLight* Lamp = *It;
+		// Destroying components of a GC cluster would dissolve it, a lamp clustered while the field was off keeps its own
+		const bool bClustered = GUObjectArray.ObjectToObjectItem(Lamp)->GetOwnerIndex() != 0 || Lamp->HasAnyInternalFlags(EInternalObjectFlags::ClusterRoot);
+		if (!Lamp->Mesh || bClustered || Lamps.Contains(Lamp))
+		{
+			continue;
+		}
+
+		if (!Instances->GetStaticMesh())
+		{
+			Instances->SetStaticMesh(Lamp->Mesh->GetStaticMesh());
+		}
+		Instances->AddInstanceWorldSpace(Lamp->Mesh->GetComponentTransform());
+		Lamps.Add(Lamp);
+
+		// The instance body replaces both the mesh and the capsule for traces
+		BytesSaved += GetComponentSize(Lamp->Mesh);
+		Lamp->Mesh->DestroyComponent();
+		Lamp->Mesh = nullptr;
+		++ComponentsRemoved;
+		if (Lamp->CapsuleCollision)
+		{
+			BytesSaved += GetComponentSize(Lamp->CapsuleCollision);
+			Lamp->CapsuleCollision->DestroyComponent();
+			Lamp->CapsuleCollision = nullptr;
+			++ComponentsRemoved;
+		}
+	}
+
+	const SIZE_T InstancedSize = GetComponentSize(Instances);
+	SET_DWORD_STAT(STAT_LampInstances, Lamps.Num());
+	SET_DWORD_STAT(STAT_LampComponentsRemoved, ComponentsRemoved);
+	SET_MEMORY_STAT(STAT_LampComponentMemorySaved, BytesSaved > InstancedSize ? BytesSaved - InstancedSize : 0);
+	UE_LOG(LogFuturum, Log, TEXT("Lamp field: %d lamps instanced, %d components replaced by 1, %d KB of component memory replaced by %d KB"),
+		Lamps.Num(), ComponentsRemoved, (int32)(BytesSaved / 1024), (int32)(InstancedSize / 1024));
+}
+
+void ALampField::Use()
+{
+	return;
+}
+
+void ALampField::UseItem(int32 Item)
+{
+	if (Lamps.IsValidIndex(Item) && Lamps[Item])
+	{
+		Lamps[Item]->Use();
+	}
+}
+
+float ALampField::TakeDamage(float Damage, FDamageEvent const& DamageEvent, AController* EventInstigator, AActor* DamageCauser)
+{
+	// Every instance caught by the explosion passes the damage on to its lamp
+	if (DamageEvent.IsOfType(FRadialDamageEvent::ClassID))
+	{
+		const FRadialDamageEvent& RadialDamageEvent = static_cast<const FRadialDamageEvent&>(DamageEvent);
+		for (const FHitResult& Hit : RadialDamageEvent.ComponentHits)
+		{
+			AActor* Lamp = Lamps.IsValidIndex(Hit.Item) ? Lamps[Hit.Item] : nullptr;
+			if (Lamp)
+			{
+				Lamp->TakeDamage(Damage, DamageEvent, EventInstigator, DamageCauser);
+			}
+		}
+	}
+	else
+	{
+		FHitResult Hit;
+		FVector ImpulseDirection;
+		DamageEvent.GetBestHitInfo(this, DamageCauser, Hit, ImpulseDirection);
+		AActor* Lamp = Lamps.IsValidIndex(Hit.Item) ? Lamps[Hit.Item] : nullptr;
+		if (Lamp)
+		{
+			Lamp->TakeDamage(Damage, DamageEvent, EventInstigator, DamageCauser);
+		}
+	}
+	return Super::TakeDamage(Damage, DamageEvent, EventInstigator, DamageCauser);
+}
@@ -0,0 +1,46 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "InteractableActor.h"
+#include "Interactable.h"
+#include "LampField.generated.h"
+
+class ADynamicLight;
+
+/**
+ * Draws the ceiling mesh of every lamp in the world with one instanced component.
+ * The lamps keep their light and sparks, their own mesh and capsule are removed and
+ * traces against an instance are forwarded to the lamp it stands for.
+ * Spawned locally on the server and on every client, it is not replicated.
+ */
+UCLASS()
+class FUTURUM_API ALampField : public AInteractableActor, public IInteractable
+{
+	GENERATED_BODY()
+
+public:
+	ALampField();
+
+	/** Futurum.InstancedLamps, lamps only join a GC cluster when the field leaves them whole */
+	static bool IsEnabled();
+
+	/** Moves the mesh of every lamp of the world into the instanced component */
+	void GatherLamps();
+
+	virtual void Use() override;
+
+	virtual void UseItem(int32 Item) override;
+
+	virtual float TakeDamage(float Damage, FDamageEvent const& DamageEvent, AController* EventInstigator, AActor* DamageCauser) override;
+
+	UPROPERTY(VisibleAnywhere)
+	UInstancedStaticMeshComponent* Instances = nullptr;
+
+private:
+	/** Lamp of every instance, by instance index */
+	UPROPERTY()
+	TArray<ADynamicLight*> Lamps;
+};
@@ -0,0 +1,96 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "LampTable.h"
+#include "Futurum.h"
+#include "DynamicLight.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Lamp color pass"), STAT_LampColorPass, STATGROUP_Futurum);
+DECLARE_CYCLE_STAT(TEXT("Lamp color commit"), STAT_LampColorCommit, STATGROUP_Futurum);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Lamp colors committed"), STAT_LampColorsCommitted, STATGROUP_Futurum);
+
+static TAutoConsoleVariable<int32> CVarLampTableSingleThread(
+	TEXT("Futurum.LampTableSingleThread"),
+	0,
+	TEXT("Runs the lamp color pass on the game thread only, to compare against the parallel pass."));
+
+void FLampTable::Add(ADynamicLight* Lamp)
+{
+	if (Lamps.Contains(Lamp))
+	{
+		return;
+	}
+
+	const FVector Location = Lamp->GetActorLocation();
+	LocationX.Add(Location.X);
+	LocationY.Add(Location.Y);
+	Colors.Add(Lamp->LightColor);
+	Changed.Add(0);
+	Lamps.Add(Lamp);
+}
+
+void FLampTable::Remove(ADynamicLight* Lamp)
+{
+	const int32 Index = Lamps.Find(Lamp);
+	if (Index != INDEX_NONE)
+	{
+		LocationX.RemoveAtSwap(Index);
+		LocationY.RemoveAtSwap(Index);
+		Colors.RemoveAtSwap(Index);
+		Changed.RemoveAtSwap(Index);
+		Lamps.RemoveAtSwap(Index);
+	}
+}
+
+void FLampTable::Reset()
+{
+	LocationX.Reset();
+	LocationY.Reset();
+	Colors.Reset();
+	Changed.Reset();
+	Lamps.Reset();
+}
+
+void FLampTable::Update(const FVector& Target)
+{
+	const int32 NumLamps = Lamps.Num();
+	if (NumLamps == 0)
+	{
+		return;
+	}
+
+	{
+		SCOPE_CYCLE_COUNTER(STAT_LampColorPass);
+
+		const int32 NumChunks = FMath::DivideAndRoundUp(NumLamps, ChunkSize);
+		const bool bSingleThread = NumChunks == 1 || CVarLampTableSingleThread.GetValueOnGameThread() != 0;
+		ParallelFor(NumChunks, [this, &Target, NumLamps](int32 Chunk)
+		{
+			const int32 End = FMath::Min((Chunk + 1) * ChunkSize, NumLamps);
+			for (int32 Index = Chunk * ChunkSize; Index < End; ++Index)
+			{
+				// Hue follows the direction from the target to the lamp
+				const FVector2D RelativePosition = FVector2D(LocationX[Index] - Target.X, LocationY[Index] - Target.Y).GetSafeNormal();
+				const float Angle = FMath::Atan2(RelativePosition.X, RelativePosition.Y) + PI;
+				const FLinearColor Color(FMath::Cos(Angle) / 2 + 0.5f, FMath::Cos(Angle + 2 * PI / 3) / 2 + 0.5f, FMath::Cos(Angle - 2 * PI / 3) / 2 + 0.5f);
+
+				Changed[Index] = !Color.Equals(Colors[Index], 1.f / 255.f);
+				if (Changed[Index])
+				{
+					Colors[Index] = Color;
+				}
+			}
+		}, bSingleThread);
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_LampColorCommit);
+	for (int32 Index = 0; Index < NumLamps; ++Index)
+	{
+		if (Changed[Index])
+		{
+			Lamps[Index]->SetLightColor(Colors[Index]);
+			INC_DWORD_STAT(STAT_LampColorsCommitted);
+		}
+	}
+}
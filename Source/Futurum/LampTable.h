@@ -0,0 +1,38 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class ADynamicLight;
+
+/**
+ * Every lamp of the world in one table, one array per field. The color pass runs over
+ * chunks of lamps on the task graph, then the lamps whose color really changed are
+ * committed on the game thread in one go.
+ */
+class FUTURUM_API FLampTable
+{
+public:
+	/** Lamps handled by one task */
+	static const int32 ChunkSize = 64;
+
+	void Add(ADynamicLight* Lamp);
+
+	void Remove(ADynamicLight* Lamp);
+
+	void Reset();
+
+	/** Recolors every lamp for the given target location. Server only. */
+	void Update(const FVector& Target);
+
+	FORCEINLINE int32 Num() const { return Lamps.Num(); }
+
+private:
+	/** Lamps never move, so their location is read once when they are added */
+	TArray<float> LocationX;
+	TArray<float> LocationY;
+	TArray<FLinearColor> Colors;
+	TArray<uint8> Changed;
+	TArray<ADynamicLight*> Lamps;
+};
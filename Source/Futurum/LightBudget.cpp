@@ -0,0 +1,167 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "LightBudget.h"
+#include "Futurum.h"
+#include "Components/LightComponent.h"
+#include "GameFramework/Pawn.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Light budget"), STAT_LightBudget, STATGROUP_Futurum);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Budgeted lights active"), STAT_LightBudgetActive, STATGROUP_Futurum);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Budgeted lights culled"), STAT_LightBudgetCulled, STATGROUP_Futurum);
+
+static TAutoConsoleVariable<int32> CVarLightBudget(
+	TEXT("Futurum.LightBudget"),
+	8,
+	TEXT("Dynamic lights kept on around the local view, pinned lights included. Negative keeps every light on."));
+
+static TAutoConsoleVariable<float> CVarLightFadeTime(
+	TEXT("Futurum.LightFadeTime"),
+	0.5f,
+	TEXT("Seconds a light takes to fade in or out when it enters or leaves the budget."));
+
+void FLightBudget::SelectLights(const FVector& ViewLocation, const FVector& ViewDirection, const TArray<FLightCandidate>& Candidates, int32 Budget, TArray<int32>& OutSelected)
+{
+	struct FRanked
+	{
+		float Significance;
+		int32 Index;
+		bool bPinned;
+
+		bool operator<(const FRanked& Other) const
+		{
+			if (bPinned != Other.bPinned)
+			{
+				return bPinned;
+			}
+			if (Significance != Other.Significance)
+			{
+				return Significance > Other.Significance;
+			}
+			return Index < Other.Index;
+		}
+	};
+
+	TArray<FRanked> Ranked;
+	Ranked.Reserve(Candidates.Num());
+	for (int32 Index = 0; Index < Candidates.Num(); ++Index)
+	{
+		Ranked.Add({ GetSignificance(ViewLocation, ViewDirection, Candidates[Index]), Index, Candidates[Index].bPinned });
+	}
+	// The order is total, so any sort gives the same result
+	Ranked.Sort();
+
+	const int32 NumSelected = Budget < 0 ? Ranked.Num() : FMath::Min(Budget, Ranked.Num());
+	for (int32 Rank = 0; Rank < NumSelected; ++Rank)
+	{
+		OutSelected.Add(Ranked[Rank].Index);
+	}
+}
+
+float FLightBudget::GetSignificance(const FVector& ViewLocation, const FVector& ViewDirection, const FLightCandidate& Candidate)
+{
+	const FVector ToLight = Candidate.Location - ViewLocation;
+	const float Distance = ToLight.Size();
+
+	// Size of the influence sphere on screen, above 1 when the view is inside it
+	const float Coverage = Candidate.Radius / FMath::Max(Distance, 1.f);
+
+	// Lights behind the view still light what is in front of it, just less of it
+	const float Facing = Distance > KINDA_SMALL_NUMBER ? (ToLight / Distance) | ViewDirection : 1.f;
+	const float FacingWeight = FMath::Lerp(0.25f, 1.f, FMath::Clamp((Facing + 0.5f) / 1.5f, 0.f, 1.f));
+
+	return Coverage * FacingWeight;
+}
+
+void FLightBudget::Register(ULightComponent* Light)
+{
+	for (const FManagedLight& Managed : Lights)
+	{
+		if (Managed.Light.Get() == Light)
+		{
+			return;
+		}
+	}
+
+	FManagedLight& Managed = Lights[Lights.AddDefaulted()];
+	Managed.Light = Light;
+	Managed.Intensity = Light->Intensity;
+}
+
+void FLightBudget::Unregister(ULightComponent* Light)
+{
+	for (int32 Index = 0; Index < Lights.Num(); ++Index)
+	{
+		if (Lights[Index].Light.Get() == Light)
+		{
+			Lights.RemoveAtSwap(Index);
+			return;
+		}
+	}
+}
+
+void FLightBudget::Reset()
+{
+	Lights.Reset();
+	Keep.Empty();
+	SET_DWORD_STAT(STAT_LightBudgetActive, 0);
+	SET_DWORD_STAT(STAT_LightBudgetCulled, 0);
+}
+
+void FLightBudget::Update(const FVector& ViewLocation, const FVector& ViewDirection, float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_LightBudget);
+
+	// Lights turned off by gameplay do not take a place in the budget. Only the visible flag
+	// tells, IsVisible() also reads the hidden in game flag the budget sets itself
+	Candidates.Reset();
+	CandidateLights.Reset();
+	for (int32 Index = 0; Index < Lights.Num(); ++Index)
+	{
+		const ULightComponent* Light = Lights[Index].Light.Get();
+		if (Light && Light->bVisible)
+		{
+			FLightCandidate& Candidate = Candidates[Candidates.AddDefaulted()];
+			Candidate.Location = Light->GetComponentLocation();
+			Candidate.Radius = Light->GetBoundingSphere().W;
+			// Possession can change, so the pawn is asked every time
+			const APawn* Pawn = Cast<APawn>(Light->GetOwner());
+			Candidate.bPinned = Pawn && Pawn->IsLocallyControlled();
+			CandidateLights.Add(Index);
+		}
+	}
+
+	Selected.Reset();
+	SelectLights(ViewLocation, ViewDirection, Candidates, CVarLightBudget.GetValueOnGameThread(), Selected);
+
+	Keep.Init(false, Lights.Num());
+	for (int32 Candidate : Selected)
+	{
+		Keep[CandidateLights[Candidate]] = true;
+	}
+
+	const float FadeStep = DeltaTime / FMath::Max(CVarLightFadeTime.GetValueOnGameThread(), KINDA_SMALL_NUMBER);
+	int32 Active = 0;
+	int32 Stale = 0;
+	for (int32 Index = 0; Index < Lights.Num(); ++Index)
+	{
+		FManagedLight& Managed = Lights[Index];
+		ULightComponent* Light = Managed.Light.Get();
+		if (!Light)
+		{
+			++Stale;
+			continue;
+		}
+		const float Fade = FMath::Clamp(Managed.Fade + (Keep[Index] ? FadeStep : -FadeStep), 0.f, 1.f);
+		if (Fade != Managed.Fade)
+		{
+			Managed.Fade = Fade;
+			Light->SetIntensity(Managed.Intensity * Fade);
+			Light->SetHiddenInGame(Fade <= 0.f);
+		}
+		Active += Fade > 0.f ? 1 : 0;
+	}
+
+	SET_DWORD_STAT(STAT_LightBudgetActive, Active);
+	SET_DWORD_STAT(STAT_LightBudgetCulled, Lights.Num() - Stale - Active);
+}
@@ -0,0 +1,76 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class ULightComponent;
+
+/** What the selection knows about a light */
+struct FLightCandidate
+{
+	FVector Location = FVector::ZeroVector;
+	float Radius = 0.f;
+
+	/** Kept whatever the budget, like the local player's own spotlight */
+	bool bPinned = false;
+};
+
+/**
+ * Keeps the most significant dynamic lights of the local view on and fades the others out.
+ * Lights are ranked every frame by how much of the screen their influence covers and whether
+ * they are in front of the view, the Futurum.LightBudget best ones fade in, the rest fade out
+ * and are hidden once dark. Hiding uses the hidden in game flag, so the visibility set by
+ * gameplay is left alone. Lights are only managed where something is rendered.
+ */
+class FUTURUM_API FLightBudget
+{
+public:
+	/**
+	 * Appends to OutSelected the indices of the Budget most significant candidates, pinned ones
+	 * first, in decreasing significance. Equal significance keeps the candidate order, so the
+	 * result only depends on the arguments.
+	 */
+	static void SelectLights(const FVector& ViewLocation, const FVector& ViewDirection, const TArray<FLightCandidate>& Candidates, int32 Budget, TArray<int32>& OutSelected);
+
+	/** How much a light matters to the view, higher is more */
+	static float GetSignificance(const FVector& ViewLocation, const FVector& ViewDirection, const FLightCandidate& Candidate);
+
+	/** Lights of the locally controlled pawn are pinned */
+	void Register(ULightComponent* Light);
+
+	void Unregister(ULightComponent* Light);
+
+	void Reset();
+
+	/** Ranks the lights for the view and moves their fades along */
+	void Update(const FVector& ViewLocation, const FVector& ViewDirection, float DeltaTime);
+
+	FORCEINLINE int32 Num() const { return Lights.Num(); }
+
+	FORCEINLINE SIZE_T GetAllocatedSize() const
+	{
+		return Lights.GetAllocatedSize() + Candidates.GetAllocatedSize() + CandidateLights.GetAllocatedSize() + Selected.GetAllocatedSize() + Keep.GetAllocatedSize();
+	}
+
+private:
+	struct FManagedLight
+	{
+		/** Lights destroyed without unregistering, with their owner's level for instance, are skipped */
+		TWeakObjectPtr<ULightComponent> Light;
+
+		/** Intensity the light had when registered, the fade scales it */
+		float Intensity = 0.f;
+
+		/** 0 dark and hidden, 1 full intensity */
+		float Fade = 1.f;
+	};
+
+	TArray<FManagedLight> Lights;
+
+	// Reused every update
+	TArray<FLightCandidate> Candidates;
+	TArray<int32> CandidateLights;
+	TArray<int32> Selected;
+	TBitArray<> Keep;
+};
@@ -0,0 +1,160 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MatchSnapshot.h"
+#include "Futurum.h"
+#include "BallEnemy.h"
+#include "DynamicLight.h"
+#include "FuturumProjectile.h"
+#include "FuturumGameState.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "UObject/UObjectGlobals.h"
+
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Last match restore (ms)"), STAT_LastMatchRestore, STATGROUP_Futurum);
+
+namespace
+{
+	double MapLoadStartTime = 0.0;
+	float LastMapLoadTime = 0.f;
+	FDelegateHandle PreLoadMapHandle;
+	FDelegateHandle PostLoadMapHandle;
+}
+
+void FMatchSnapshot::Startup()
+{
+	PreLoadMapHandle = FCoreUObjectDelegates::PreLoadMap.AddLambda([](const FString& MapName)
+	{
+		MapLoadStartTime = FPlatformTime::Seconds();
+	});
+	PostLoadMapHandle = FCoreUObjectDelegates::PostLoadMapWithWorld.AddLambda([](UWorld* World)
+	{
+		if (MapLoadStartTime > 0.0)
+		{
+			LastMapLoadTime = FPlatformTime::Seconds() - MapLoadStartTime;
+			MapLoadStartTime = 0.0;
+		}
+	});
+}
+
+void FMatchSnapshot::Shutdown()
+{
+	FCoreUObjectDelegates::PreLoadMap.Remove(PreLoadMapHandle);
+	FCoreUObjectDelegates::PostLoadMapWithWorld.Remove(PostLoadMapHandle);
+}
+
+float FMatchSnapshot::GetLastMapLoadTime()
+{
+	return LastMapLoadTime;
+}
+
+void FMatchSnapshot::Capture(UWorld* World, TSubclassOf<ABallEnemy> InEnemyClass, const TArray<FMatchTimer>& PendingTimers)
+{
+	Reset();
+	EnemyClass = InEnemyClass;
+	Timers = PendingTimers;
+
+	for (TActorIterator<ADynamicLight> It(World); It; ++It)
+	{
+		Lamps.Add({ *It, It->LightColor, It->bLightOn });
+	}
+
+	for (TActorIterator<AActor> It(World); It; ++It)
+	{
+		ABallEnemy* Enemy = Cast<ABallEnemy>(*It);
+		UStaticMeshComponent* Body = Cast<UStaticMeshComponent>(It->GetRootComponent());
+		if (Enemy)
+		{
+			Enemies.Add({ Enemy, Enemy->GetActorTransform(), Body->GetPhysicsLinearVelocity(), Body->GetPhysicsAngularVelocityInDegrees() });
+		}
+		else if (Body && Body->IsSimulatingPhysics())
+		{
+			Bodies.Add({ Body, Body->GetComponentTransform() });
+		}
+	}
+
+	bCaptured = true;
+	UE_LOG(LogFuturum, Log, TEXT("Match snapshot: %d lamps, %d physics bodies, %d enemies, %d timers"), Lamps.Num(), Bodies.Num(), Enemies.Num(), Timers.Num());
+}
+
+float FMatchSnapshot::Restore(UWorld* World)
+{
+	const double StartTime = FPlatformTime::Seconds();
+
+	// Nothing from the old match may land in the new one
+	for (TActorIterator<AFuturumProjectile> It(World); It; ++It)
+	{
+		It->Destroy();
+	}
+	AFuturumGameState* GameState = World->GetGameState<AFuturumGameState>();
+	if (GameState)
+	{
+		GameState->GetSceneQueries().Reset();
+	}
+
+	for (const FLampState& State : Lamps)
+	{
+		if (State.Lamp.IsValid())
+		{
+			State.Lamp->SetLightColor(State.LightColor);
+			State.Lamp->SetState(State.bLightOn);
+		}
+	}
+
+	for (const FBodyState& State : Bodies)
+	{
+		if (State.Body.IsValid())
+		{
+			State.Body->SetWorldTransform(State.Transform, false, nullptr, ETeleportType::TeleportPhysics);
+			State.Body->SetPhysicsLinearVelocity(FVector::ZeroVector);
+			State.Body->SetPhysicsAngularVelocityInDegrees(FVector::ZeroVector);
+		}
+	}
+
+	// Enemies spawned after the capture go away, the captured ones come back
+	TSet<ABallEnemy*> CapturedEnemies;
+	for (const FEnemyState& State : Enemies)
+	{
+		CapturedEnemies.Add(State.Enemy.Get());
+	}
+	for (TActorIterator<ABallEnemy> It(World); It; ++It)
+	{
+		if (!CapturedEnemies.Contains(*It))
+		{
+			It->Destroy();
+		}
+	}
+
+	int32 Respawned = 0;
+	for (FEnemyState& State : Enemies)
+	{
+		if (!State.Enemy.IsValid() || State.Enemy->IsPendingKillPending())
+		{
+			FActorSpawnParameters SpawnParams;
+			SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+			SpawnParams.ObjectFlags |= RF_Transient;
+			State.Enemy = World->SpawnActor<ABallEnemy>(EnemyClass, State.Transform, SpawnParams);
+			++Respawned;
+		}
+		if (State.Enemy.IsValid())
+		{
+			State.Enemy->RestoreState(State.Transform, State.Velocity, State.AngularVelocity);
+		}
+	}
+
+	const float RestoreTime = FPlatformTime::Seconds() - StartTime;
+	SET_FLOAT_STAT(STAT_LastMatchRestore, RestoreTime * 1000.f);
+	UE_LOG(LogFuturum, Log, TEXT("Match restored in %.2f ms, %d enemies spawned again, last map load took %.2f ms"),
+		RestoreTime * 1000.f, Respawned, GetLastMapLoadTime() * 1000.f);
+	return RestoreTime;
+}
+
+void FMatchSnapshot::Reset()
+{
+	Lamps.Reset();
+	Bodies.Reset();
+	Enemies.Reset();
+	Timers.Reset();
+	EnemyClass = nullptr;
+	bCaptured = false;
+}
@@ -0,0 +1,83 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class ABallEnemy;
+class ADynamicLight;
+class UStaticMeshComponent;
+
+/** Timers the game mode schedules, named so a snapshot can schedule them again */
+enum class EMatchTimer : uint8
+{
+	/** Lights back on after an enemy was spawned in the dark */
+	LightsOn
+};
+
+struct FMatchTimer
+{
+	EMatchTimer Type;
+	float Remaining;
+};
+
+/**
+ * State of a match right after it started, put back in place to restart the match without
+ * reloading the map. Lamps, physics props and surviving enemies are reset where they are, only
+ * enemies killed since the capture are spawned again and enemies spawned since are destroyed.
+ * The game mode's pending timers are kept with their remaining time for it to schedule again.
+ */
+class FUTURUM_API FMatchSnapshot
+{
+public:
+	/** Times map loads so restores can be compared against them, called by the module */
+	static void Startup();
+
+	static void Shutdown();
+
+	/** Seconds the last map load took, 0 before the first one */
+	static float GetLastMapLoadTime();
+
+	void Capture(UWorld* World, TSubclassOf<ABallEnemy> EnemyClass, const TArray<FMatchTimer>& PendingTimers);
+
+	/** Returns the number of seconds the restore took */
+	float Restore(UWorld* World);
+
+	FORCEINLINE bool IsValid() const { return bCaptured; }
+
+	/** Game mode timers pending at the capture */
+	FORCEINLINE const TArray<FMatchTimer>& GetTimers() const { return Timers; }
+
+	void Reset();
+
+private:
+	struct FLampState
+	{
+		TWeakObjectPtr<ADynamicLight> Lamp;
+		FLinearColor LightColor;
+		bool bLightOn;
+	};
+
+	struct FBodyState
+	{
+		TWeakObjectPtr<UStaticMeshComponent> Body;
+		FTransform Transform;
+	};
+
+	struct FEnemyState
+	{
+		TWeakObjectPtr<ABallEnemy> Enemy;
+		FTransform Transform;
+		FVector Velocity;
+		FVector AngularVelocity;
+	};
+
+	TArray<FLampState> Lamps;
+	TArray<FBodyState> Bodies;
+	TArray<FEnemyState> Enemies;
+	TArray<FMatchTimer> Timers;
+
+	TSubclassOf<ABallEnemy> EnemyClass;
+
+	bool bCaptured = false;
+};
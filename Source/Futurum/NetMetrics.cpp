@@ -0,0 +1,307 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "NetMetrics.h"
+#include "Futurum.h"
+#include "GameFramework/Actor.h"
+#include "Engine/NetDriver.h"
+#include "Engine/NetConnection.h"
+#include "Engine/Channel.h"
+#include "Engine/Engine.h"
+#include "Engine/PackageMapClient.h"
+#include "Engine/World.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "UObject/UnrealType.h"
+#include "UObject/CoreNet.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pending reliable bunches (worst connection)"), STAT_PendingReliableBunches, STATGROUP_Futurum);
+
+static TAutoConsoleVariable<float> CVarNetMetricsInterval(
+	TEXT("Futurum.NetMetricsInterval"),
+	10.f,
+	TEXT("Seconds between two writes of the network metrics file, 0 to stop writing it."));
+
+namespace
+{
+	/** One writer for every measure, measuring happens on the game thread on every RPC */
+	FNetBitWriter& GetMeasureWriter()
+	{
+		static FNetBitWriter Writer(nullptr, 1024);
+		Writer.Reset();
+		return Writer;
+	}
+
+	/** Writes a value the way the replication layout does, arrays with a 16 bit count and plain structs field by field */
+	void SerializeValue(FArchive& Writer, const UProperty* Property, const void* Value, UNetDriver* NetDriver)
+	{
+		for (int32 Index = 0; Index < Property->ArrayDim; ++Index)
+		{
+			void* Element = (uint8*)Value + Index * Property->ElementSize;
+			if (const UArrayProperty* ArrayProperty = Cast<UArrayProperty>(Property))
+			{
+				FScriptArrayHelper Array(ArrayProperty, Element);
+				uint16 Num = Array.Num();
+				Writer << Num;
+				for (int32 ArrayIndex = 0; ArrayIndex < Array.Num(); ++ArrayIndex)
+				{
+					SerializeValue(Writer, ArrayProperty->Inner, Array.GetRawPtr(ArrayIndex), NetDriver);
+				}
+			}
+			else if (const UObjectPropertyBase* ObjectProperty = Cast<UObjectPropertyBase>(Property))
+			{
+				// Only the GUID once the client knows the object, measuring must not export its path
+				const UObject* Object = ObjectProperty->GetObjectPropertyValue(Element);
+				FNetworkGUID NetGUID;
+				if (Object && NetDriver && NetDriver->GuidCache.IsValid())
+				{
+					NetGUID = NetDriver->GuidCache->GetNetGUID(Object);
+				}
+				Writer << NetGUID;
+			}
+			else if (const UStructProperty* StructProperty = Cast<UStructProperty>(Property))
+			{
+				if (StructProperty->Struct->StructFlags & STRUCT_NetSerializeNative)
+				{
+					StructProperty->NetSerializeItem(Writer, nullptr, Element);
+				}
+				else
+				{
+					for (TFieldIterator<UProperty> It(StructProperty->Struct); It; ++It)
+					{
+						if (!It->HasAnyPropertyFlags(CPF_RepSkip))
+						{
+							SerializeValue(Writer, *It, It->ContainerPtrToValuePtr<void>(Element), NetDriver);
+						}
+					}
+				}
+			}
+			else
+			{
+				Property->NetSerializeItem(Writer, nullptr, Element);
+			}
+		}
+	}
+}
+
+FNetMetrics& FNetMetrics::Get()
+{
+	static FNetMetrics Metrics;
+	return Metrics;
+}
+
+void FNetMetrics::Startup()
+{
+	TickerHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FNetMetrics::Tick));
+}
+
+void FNetMetrics::Shutdown()
+{
+	FTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+	Connections.Reset();
+}
+
+void FNetMetrics::RecordRPC(FName Name, UNetConnection* Connection, int32 Bytes)
+{
+	Record(EKind::RPC, Name, Connection, Bytes);
+}
+
+void FNetMetrics::RecordMulticast(FName Name, AActor* Actor, int32 Bytes)
+{
+	RecordForActor(EKind::RPC, Name, Actor, Bytes);
+}
+
+void FNetMetrics::RecordProperty(FName Name, AActor* Actor, int32 Bytes)
+{
+	RecordForActor(EKind::Property, Name, Actor, Bytes);
+}
+
+FNetMetrics::FConnectionMetrics& FNetMetrics::FindOrAddConnection(UNetConnection* Connection)
+{
+	FConnectionMetrics* Metrics = Connections.Find(Connection);
+	if (!Metrics)
+	{
+		Metrics = &Connections.Add(Connection);
+		Metrics->Address = Connection->LowLevelGetRemoteAddress(true);
+	}
+	return *Metrics;
+}
+
+void FNetMetrics::Record(EKind Kind, FName Name, UNetConnection* Connection, int32 Bytes)
+{
+	if (!Connection)
+	{
+		return;
+	}
+
+	FKey Key;
+	Key.Kind = Kind;
+	Key.Name = Name;
+
+	FCounter& Counter = FindOrAddConnection(Connection).Counters.FindOrAdd(Key);
+	++Counter.Calls;
+	Counter.Bytes += Bytes;
+}
+
+void FNetMetrics::RecordForActor(EKind Kind, FName Name, AActor* Actor, int32 Bytes)
+{
+	UNetDriver* NetDriver = Actor->GetNetDriver();
+	if (!NetDriver || Actor->GetNetMode() == NM_Client)
+	{
+		return;
+	}
+
+	for (UNetConnection* Connection : NetDriver->ClientConnections)
+	{
+		if (Connection && Connection->ActorChannels.Contains(Actor))
+		{
+			Record(Kind, Name, Connection, Bytes);
+		}
+	}
+}
+
+int32 FNetMetrics::GetParametersSize(const UFunction* Function, UNetConnection* Connection, const void* const* Values, int32 NumValues)
+{
+	FNetBitWriter& Writer = GetMeasureWriter();
+	int32 Index = 0;
+	for (TFieldIterator<UProperty> It(Function); It && (It->PropertyFlags & (CPF_Parm | CPF_ReturnParm)) == CPF_Parm; ++It, ++Index)
+	{
+		check(Index < NumValues);
+
+		// Every parameter but a bool is preceded by a bit telling whether it is sent
+		if (!It->IsA<UBoolProperty>())
+		{
+			Writer.WriteBit(1);
+		}
+		SerializeValue(Writer, *It, Values[Index], Connection ? Connection->Driver : nullptr);
+	}
+	check(Index == NumValues);
+	return Writer.GetNumBytes();
+}
+
+int32 FNetMetrics::GetPropertySize(const UProperty* Property, const AActor* Actor)
+{
+	FNetBitWriter& Writer = GetMeasureWriter();
+	SerializeValue(Writer, Property, Property->ContainerPtrToValuePtr<void>(Actor), Actor->GetNetDriver());
+	return Writer.GetNumBytes();
+}
+
+int32 FNetMetrics::GetStructSize(const UStruct* Struct, const void* Value, UNetDriver* NetDriver)
+{
+	FNetBitWriter& Writer = GetMeasureWriter();
+	SerializeStruct(Writer, Struct, Value, NetDriver);
+	return Writer.GetNumBytes();
+}
+
+void FNetMetrics::SerializeStruct(FArchive& Writer, const UStruct* Struct, const void* Value, UNetDriver* NetDriver)
+{
+	for (TFieldIterator<UProperty> It(Struct); It; ++It)
+	{
+		if (!It->HasAnyPropertyFlags(CPF_RepSkip))
+		{
+			SerializeValue(Writer, *It, It->ContainerPtrToValuePtr<void>(Value), NetDriver);
+		}
+	}
+}
+
+bool FNetMetrics::Tick(float DeltaTime)
+{
+	SampleReliableBuffers();
+
+	const float Interval = CVarNetMetricsInterval.GetValueOnGameThread();
+	TimeSinceWrite += DeltaTime;
+	if (Interval > 0.f && TimeSinceWrite >= Interval && Connections.Num() > 0)
+	{
+		TimeSinceWrite = 0.f;
+		Write();
+	}
+	return true;
+}
+
+void FNetMetrics::SampleReliableBuffers()
+{
+	if (!GEngine)
+	{
+		return;
+	}
+
+	int32 WorstPending = 0;
+	for (const FWorldContext& Context : GEngine->GetWorldContexts())
+	{
+		UWorld* World = Context.World();
+		UNetDriver* NetDriver = World ? World->GetNetDriver() : nullptr;
+		if (!NetDriver || World->GetNetMode() == NM_Client)
+		{
+			continue;
+		}
+
+		for (UNetConnection* Connection : NetDriver->ClientConnections)
+		{
+			if (!Connection)
+			{
+				continue;
+			}
+
+			int32 Pending = 0;
+			for (UChannel* Channel : Connection->OpenChannels)
+			{
+				Pending += Channel ? Channel->NumOutRec : 0;
+			}
+
+			FReliableBuffer& Buffer = FindOrAddConnection(Connection).ReliableBuffer;
+			Buffer.Pending = Pending;
+			Buffer.Peak = FMath::Max(Buffer.Peak, Pending);
+			WorstPending = FMath::Max(WorstPending, Pending);
+		}
+	}
+	SET_DWORD_STAT(STAT_PendingReliableBunches, WorstPending);
+}
+
+void FNetMetrics::Write()
+{
+	FString RPCCalls = TEXT("# HELP futurum_rpc_calls_total RPC calls sent to or received from a client connection.\n# TYPE futurum_rpc_calls_total counter\n");
+	FString RPCBytes = TEXT("# HELP futurum_rpc_bytes_total RPC parameter bytes sent to or received from a client connection.\n# TYPE futurum_rpc_bytes_total counter\n");
+	FString PropertyUpdates = TEXT("# HELP futurum_property_updates_total Replicated property changes for a client connection.\n# TYPE futurum_property_updates_total counter\n");
+	FString PropertyBytes = TEXT("# HELP futurum_property_bytes_total Replicated property bytes for a client connection.\n# TYPE futurum_property_bytes_total counter\n");
+
+	FString ReliablePending = TEXT("# HELP futurum_reliable_bunches_pending Reliable bunches sent to a client connection and not acked yet.\n# TYPE futurum_reliable_bunches_pending gauge\n");
+	FString ReliablePeak = TEXT("# HELP futurum_reliable_bunches_peak Most reliable bunches waiting for an ack on a client connection at once.\n# TYPE futurum_reliable_bunches_peak gauge\n");
+
+	for (auto It = Connections.CreateIterator(); It; ++It)
+	{
+		const FConnectionMetrics& Metrics = It.Value();
+		for (const TPair<FKey, FCounter>& Counter : Metrics.Counters)
+		{
+			const bool bRPC = Counter.Key.Kind == EKind::RPC;
+			const FString Labels = FString::Printf(TEXT("{%s=\"%s\",connection=\"%s\"}"),
+				bRPC ? TEXT("rpc") : TEXT("property"), *Counter.Key.Name.ToString(), *Metrics.Address);
+			(bRPC ? RPCCalls : PropertyUpdates) += FString::Printf(TEXT("%s%s %llu\n"),
+				bRPC ? TEXT("futurum_rpc_calls_total") : TEXT("futurum_property_updates_total"), *Labels, Counter.Value.Calls);
+			(bRPC ? RPCBytes : PropertyBytes) += FString::Printf(TEXT("%s%s %llu\n"),
+				bRPC ? TEXT("futurum_rpc_bytes_total") : TEXT("futurum_property_bytes_total"), *Labels, Counter.Value.Bytes);
+		}
+
+		ReliablePending += FString::Printf(TEXT("futurum_reliable_bunches_pending{connection=\"%s\"} %d\n"), *Metrics.Address, Metrics.ReliableBuffer.Pending);
+		ReliablePeak += FString::Printf(TEXT("futurum_reliable_bunches_peak{connection=\"%s\"} %d\n"), *Metrics.Address, Metrics.ReliableBuffer.Peak);
+
+		// Its last counts are in this file, a connection is never seen again once closed
+		const UNetConnection* Connection = It.Key().Get();
+		if (!Connection || Connection->State == USOCK_Closed)
+		{
+			It.RemoveCurrent();
+		}
+	}
+
+	// Written aside then moved, a scraper never reads half a file
+	const FString Filename = FPaths::ProjectSavedDir() / TEXT("Metrics") / TEXT("futurum_net.prom");
+	const FString TempFilename = Filename + TEXT(".tmp");
+	if (FFileHelper::SaveStringToFile(RPCCalls + RPCBytes + PropertyUpdates + PropertyBytes + ReliablePending + ReliablePeak, *TempFilename))
+	{
+		IFileManager::Get().Move(*Filename, *TempFilename, true, true);
+	}
+	else
+	{
+		UE_LOG(LogFuturum, Warning, TEXT("Could not write network metrics to %s"), *TempFilename);
+	}
+}
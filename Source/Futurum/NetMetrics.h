@@ -0,0 +1,130 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+
+class AActor;
+class UFunction;
+class UNetConnection;
+class UNetDriver;
+class UProperty;
+class UStruct;
+
+/**
+ * Calls and payload bytes of the game RPCs and replicated properties, per client connection.
+ * Counted on the server and written every Futurum.NetMetricsInterval seconds to
+ * Saved/Metrics/futurum_net.prom in the Prometheus text format, for a file scraper to pick up.
+ * Bytes are the parameters or property value run through the same net serializers as the replication
+ * code, object references count as their net GUID. Bunch and packet headers are not included.
+ * The reliable bunches waiting for an ack on each connection are sampled every frame, to see how
+ * close the game traffic brings the reliable buffer to overflowing. A closed connection is written
+ * one last time and then forgotten.
+ */
+class FUTURUM_API FNetMetrics
+{
+public:
+	static FNetMetrics& Get();
+
+	/** Hooks the periodic write, called by the module */
+	void Startup();
+
+	void Shutdown();
+
+	/** RPC from or to a single connection */
+	void RecordRPC(FName Name, UNetConnection* Connection, int32 Bytes);
+
+	/** Multicast RPC, counted for every connection the actor is replicated to */
+	void RecordMulticast(FName Name, AActor* Actor, int32 Bytes);
+
+	/** Property change, counted for every connection the actor is replicated to */
+	void RecordProperty(FName Name, AActor* Actor, int32 Bytes);
+
+	/** Writes the file and drops the closed connections */
+	void Write();
+
+	/**
+	 * Serialized bytes of the parameters of an RPC, given in declaration order. Callers measuring
+	 * on every call look the function up once and keep it.
+	 */
+	template<typename... ParamTypes>
+	static int32 GetParametersSize(const UFunction* Function, UNetConnection* Connection, const ParamTypes&... Params)
+	{
+		const void* Values[] = { &Params..., nullptr };
+		return GetParametersSize(Function, Connection, Values, sizeof...(Params));
+	}
+
+	/** Serialized bytes of the current value of a replicated property of the actor */
+	static int32 GetPropertySize(const UProperty* Property, const AActor* Actor);
+
+	/** Serialized bytes of a struct value, property by property */
+	static int32 GetStructSize(const UStruct* Struct, const void* Value, UNetDriver* NetDriver);
+
+	/** Writes a struct value property by property, the way GetStructSize measures it */
+	static void SerializeStruct(FArchive& Writer, const UStruct* Struct, const void* Value, UNetDriver* NetDriver);
+
+private:
+	static int32 GetParametersSize(const UFunction* Function, UNetConnection* Connection, const void* const* Values, int32 NumValues);
+
+	enum class EKind : uint8
+	{
+		RPC,
+		Property
+	};
+
+	struct FKey
+	{
+		EKind Kind;
+		FName Name;
+
+		bool operator==(const FKey& Other) const
+		{
+			return Kind == Other.Kind && Name == Other.Name;
+		}
+
+		friend uint32 GetTypeHash(const FKey& Key)
+		{
+			return HashCombine(GetTypeHash((uint8)Key.Kind), GetTypeHash(Key.Name));
+		}
+	};
+
+	struct FCounter
+	{
+		uint64 Calls = 0;
+		uint64 Bytes = 0;
+	};
+
+	struct FReliableBuffer
+	{
+		int32 Pending = 0;
+		int32 Peak = 0;
+	};
+
+	struct FConnectionMetrics
+	{
+		/** Label of the connection, taken once when it is first seen */
+		FString Address;
+
+		TMap<FKey, FCounter> Counters;
+
+		/** Reliable bunches not acked yet, over all channels of the connection */
+		FReliableBuffer ReliableBuffer;
+	};
+
+	FConnectionMetrics& FindOrAddConnection(UNetConnection* Connection);
+
+	void Record(EKind Kind, FName Name, UNetConnection* Connection, int32 Bytes);
+
+	void RecordForActor(EKind Kind, FName Name, AActor* Actor, int32 Bytes);
+
+	bool Tick(float DeltaTime);
+
+	void SampleReliableBuffers();
+
+	TMap<TWeakObjectPtr<UNetConnection>, FConnectionMetrics> Connections;
+
+	FDelegateHandle TickerHandle;
+
+	float TimeSinceWrite = 0.f;
+};
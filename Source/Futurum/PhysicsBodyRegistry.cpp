@@ -0,0 +1,62 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PhysicsBodyRegistry.h"
+#include "Components/StaticMeshComponent.h"
+
+const float FPhysicsBodyRegistry::CellSize = 1000.f;
+
+FPhysicsBodyRegistry::~FPhysicsBodyRegistry()
+{
+	check(Bodies.Num() == 0);
+}
+
+void FPhysicsBodyRegistry::Register(UStaticMeshComponent* Body)
+{
+	if (Body == nullptr || Bodies.Contains(Body))
+	{
+		return;
+	}
+
+	FBodyEntry& Entry = Bodies.Add(Body);
+	Entry.Cell = GetCell(Body->GetComponentLocation());
+	Entry.MovedHandle = Body->TransformUpdated.AddRaw(this, &FPhysicsBodyRegistry::OnBodyMoved);
+	Cells.FindOrAdd(Entry.Cell).Add(Body);
+}
+
+void FPhysicsBodyRegistry::Unregister(UStaticMeshComponent* Body)
+{
+	FBodyEntry Entry;
+	if (Bodies.RemoveAndCopyValue(Body, Entry))
+	{
+		Body->TransformUpdated.Remove(Entry.MovedHandle);
+		Cells.FindChecked(Entry.Cell).RemoveSwap(Body);
+	}
+}
+
+void FPhysicsBodyRegistry::Reset()
+{
+	for (const TPair<UStaticMeshComponent*, FBodyEntry>& Pair : Bodies)
+	{
+		Pair.Key->TransformUpdated.Remove(Pair.Value.MovedHandle);
+	}
+	Bodies.Empty();
+	Cells.Empty();
+}
+
+FIntPoint FPhysicsBodyRegistry::GetCell(const FVector& Location)
+{
+	return FIntPoint(FMath::FloorToInt(Location.X / CellSize), FMath::FloorToInt(Location.Y / CellSize));
+}
+
+void FPhysicsBodyRegistry::OnBodyMoved(USceneComponent* Component, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport)
+{
+	UStaticMeshComponent* Body = static_cast<UStaticMeshComponent*>(Component);
+	FBodyEntry& Entry = Bodies.FindChecked(Body);
+	const FIntPoint NewCell = GetCell(Body->GetComponentLocation());
+	if (NewCell != Entry.Cell)
+	{
+		Cells.FindChecked(Entry.Cell).RemoveSwap(Body);
+		Cells.FindOrAdd(NewCell).Add(Body);
+		Entry.Cell = NewCell;
+	}
+}
@@ -0,0 +1,65 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/SceneComponent.h"
+
+class UStaticMeshComponent;
+
+/**
+ * Physics simulated meshes that explosions push around, bucketed into a uniform XY grid.
+ * Bodies move between cells as their transform updates, so an explosion only walks the
+ * cells it covers and gets plain component pointers back, with no overlap query or casts.
+ */
+class FUTURUM_API FPhysicsBodyRegistry
+{
+public:
+	/** Side of a grid cell in world units */
+	static const float CellSize;
+
+	~FPhysicsBodyRegistry();
+
+	void Register(UStaticMeshComponent* Body);
+
+	void Unregister(UStaticMeshComponent* Body);
+
+	/** Drops every body, call before the bodies go away */
+	void Reset();
+
+	/** Appends the bodies in the cells overlapping the sphere, may include some just outside of it */
+	template<typename AllocatorType>
+	void GatherBodies(const FVector& Origin, float Radius, TArray<UStaticMeshComponent*, AllocatorType>& OutBodies) const
+	{
+		const FIntPoint Min = GetCell(Origin - FVector(Radius));
+		const FIntPoint Max = GetCell(Origin + FVector(Radius));
+		for (int32 X = Min.X; X <= Max.X; ++X)
+		{
+			for (int32 Y = Min.Y; Y <= Max.Y; ++Y)
+			{
+				const TArray<UStaticMeshComponent*>* Cell = Cells.Find(FIntPoint(X, Y));
+				if (Cell)
+				{
+					OutBodies.Append(*Cell);
+				}
+			}
+		}
+	}
+
+	FORCEINLINE int32 Num() const { return Bodies.Num(); }
+
+private:
+	struct FBodyEntry
+	{
+		FIntPoint Cell;
+		FDelegateHandle MovedHandle;
+	};
+
+	static FIntPoint GetCell(const FVector& Location);
+
+	void OnBodyMoved(USceneComponent* Component, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport);
+
+	TMap<FIntPoint, TArray<UStaticMeshComponent*>> Cells;
+
+	TMap<UStaticMeshComponent*, FBodyEntry> Bodies;
+};
@@ -0,0 +1,567 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ServerReplay.h"
+#include "Futurum.h"
+#include "BallEnemy.h"
+#include "DynamicLight.h"
+#include "FuturumGameState.h"
+#include "FuturumProjectile.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/PlatformFilemanager.h"
+#include "HAL/RunnableThread.h"
+#include "HAL/Event.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+DECLARE_CYCLE_STAT(TEXT("Replay record frame"), STAT_ReplayRecordFrame, STATGROUP_Futurum);
+DECLARE_CYCLE_STAT(TEXT("Replay playback frame"), STAT_ReplayPlaybackFrame, STATGROUP_Futurum);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Replay bytes recorded"), STAT_ReplayBytesRecorded, STATGROUP_Futurum);
+
+const uint32 FReplaySnapshotCodec::FileMagic = 0x31524446; // "FDR1"
+
+namespace
+{
+	enum EReplayField : uint8
+	{
+		Field_Location = 1 << 0,
+		Field_Rotation = 1 << 1,
+		Field_Health = 1 << 2,
+		Field_Color = 1 << 3,
+		Field_Flags = 1 << 4
+	};
+
+	void WriteUnsigned(FArchive& Ar, uint32 Value)
+	{
+		Ar.SerializeIntPacked(Value);
+	}
+
+	uint32 ReadUnsigned(FArchive& Ar)
+	{
+		uint32 Value = 0;
+		Ar.SerializeIntPacked(Value);
+		return Value;
+	}
+
+	// Zigzag keeps small negative deltas small once packed
+	void WriteSigned(FArchive& Ar, int32 Value)
+	{
+		WriteUnsigned(Ar, (static_cast<uint32>(Value) << 1) ^ static_cast<uint32>(Value >> 31));
+	}
+
+	int32 ReadSigned(FArchive& Ar)
+	{
+		const uint32 Value = ReadUnsigned(Ar);
+		return static_cast<int32>(Value >> 1) ^ -static_cast<int32>(Value & 1);
+	}
+
+	uint8 GetChangedFields(const FReplayEntityState& Base, const FReplayEntityState& State)
+	{
+		uint8 Mask = 0;
+		Mask |= State.Location != Base.Location ? Field_Location : 0;
+		Mask |= (State.Pitch != Base.Pitch || State.Yaw != Base.Yaw || State.Roll != Base.Roll) ? Field_Rotation : 0;
+		Mask |= State.Health != Base.Health ? Field_Health : 0;
+		Mask |= State.Color != Base.Color ? Field_Color : 0;
+		Mask |= State.Flags != Base.Flags ? Field_Flags : 0;
+		return Mask;
+	}
+
+	void WriteFields(FArchive& Ar, uint8 Mask, const FReplayEntityState& Base, const FReplayEntityState& State)
+	{
+		if (Mask & Field_Location)
+		{
+			WriteSigned(Ar, State.Location.X - Base.Location.X);
+			WriteSigned(Ar, State.Location.Y - Base.Location.Y);
+			WriteSigned(Ar, State.Location.Z - Base.Location.Z);
+		}
+		if (Mask & Field_Rotation)
+		{
+			WriteSigned(Ar, static_cast<int16>(State.Pitch - Base.Pitch));
+			WriteSigned(Ar, static_cast<int16>(State.Yaw - Base.Yaw));
+			WriteSigned(Ar, static_cast<int16>(State.Roll - Base.Roll));
+		}
+		if (Mask & Field_Health)
+		{
+			WriteSigned(Ar, State.Health - Base.Health);
+		}
+		if (Mask & Field_Color)
+		{
+			uint32 Color = State.Color;
+			Ar << Color;
+		}
+		if (Mask & Field_Flags)
+		{
+			uint8 Flags = State.Flags;
+			Ar << Flags;
+		}
+	}
+
+	void ReadFields(FArchive& Ar, uint8 Mask, FReplayEntityState& State)
+	{
+		if (Mask & Field_Location)
+		{
+			State.Location.X += ReadSigned(Ar);
+			State.Location.Y += ReadSigned(Ar);
+			State.Location.Z += ReadSigned(Ar);
+		}
+		if (Mask & Field_Rotation)
+		{
+			State.Pitch = static_cast<uint16>(State.Pitch + ReadSigned(Ar));
+			State.Yaw = static_cast<uint16>(State.Yaw + ReadSigned(Ar));
+			State.Roll = static_cast<uint16>(State.Roll + ReadSigned(Ar));
+		}
+		if (Mask & Field_Health)
+		{
+			State.Health += ReadSigned(Ar);
+		}
+		if (Mask & Field_Color)
+		{
+			Ar << State.Color;
+		}
+		if (Mask & Field_Flags)
+		{
+			Ar << State.Flags;
+		}
+	}
+
+	int32 LowerBoundById(const TArray<FReplayEntityState>& States, uint32 Id)
+	{
+		int32 First = 0;
+		int32 Count = States.Num();
+		while (Count > 0)
+		{
+			const int32 Step = Count / 2;
+			if (States[First + Step].Id < Id)
+			{
+				First += Step + 1;
+				Count -= Step + 1;
+			}
+			else
+			{
+				Count = Step;
+			}
+		}
+		return First;
+	}
+
+	/** Both tables are sorted by Id. Writes removed ids, then only the fields that changed. */
+	void EncodeTable(FArchive& Ar, const TArray<FReplayEntityState>& Previous, const TArray<FReplayEntityState>& Current)
+	{
+		TArray<uint32> Removed;
+		TArray<TPair<const FReplayEntityState*, FReplayEntityState>> Changed;
+
+		int32 PreviousIndex = 0;
+		int32 CurrentIndex = 0;
+		while (PreviousIndex < Previous.Num() || CurrentIndex < Current.Num())
+		{
+			if (CurrentIndex == Current.Num() || (PreviousIndex < Previous.Num() && Previous[PreviousIndex].Id < Current[CurrentIndex].Id))
+			{
+				Removed.Add(Previous[PreviousIndex++].Id);
+			}
+			else if (PreviousIndex == Previous.Num() || Current[CurrentIndex].Id < Previous[PreviousIndex].Id)
+			{
+				// New entities are written against an empty state
+				FReplayEntityState Base;
+				Base.Id = Current[CurrentIndex].Id;
+				Changed.Emplace(&Current[CurrentIndex++], Base);
+			}
+			else
+			{
+				if (GetChangedFields(Previous[PreviousIndex], Current[CurrentIndex]) != 0)
+				{
+					Changed.Emplace(&Current[CurrentIndex], Previous[PreviousIndex]);
+				}
+				++PreviousIndex;
+				++CurrentIndex;
+			}
+		}
+
+		uint32 LastId = 0;
+		WriteUnsigned(Ar, Removed.Num());
+		for (uint32 Id : Removed)
+		{
+			WriteUnsigned(Ar, Id - LastId);
+			LastId = Id;
+		}
+
+		LastId = 0;
+		WriteUnsigned(Ar, Changed.Num());
+		for (const TPair<const FReplayEntityState*, FReplayEntityState>& Change : Changed)
+		{
+			const FReplayEntityState& State = *Change.Key;
+			uint8 Mask = GetChangedFields(Change.Value, State);
+			WriteUnsigned(Ar, State.Id - LastId);
+			Ar << Mask;
+			WriteFields(Ar, Mask, Change.Value, State);
+			LastId = State.Id;
+		}
+	}
+
+	void DecodeTable(FArchive& Ar, const TArray<FReplayEntityState>& Previous, TArray<FReplayEntityState>& OutCurrent)
+	{
+		OutCurrent = Previous;
+
+		uint32 Id = 0;
+		const uint32 NumRemoved = ReadUnsigned(Ar);
+		for (uint32 Index = 0; Index < NumRemoved && !Ar.IsError(); ++Index)
+		{
+			Id += ReadUnsigned(Ar);
+			const int32 Found = LowerBoundById(OutCurrent, Id);
+			if (OutCurrent.IsValidIndex(Found) && OutCurrent[Found].Id == Id)
+			{
+				OutCurrent.RemoveAt(Found, 1, false);
+			}
+		}
+
+		Id = 0;
+		const uint32 NumChanged = ReadUnsigned(Ar);
+		for (uint32 Index = 0; Index < NumChanged && !Ar.IsError(); ++Index)
+		{
+			Id += ReadUnsigned(Ar);
+			uint8 Mask = 0;
+			Ar << Mask;
+
+			int32 Found = LowerBoundById(OutCurrent, Id);
+			if (!OutCurrent.IsValidIndex(Found) || OutCurrent[Found].Id != Id)
+			{
+				OutCurrent.Insert(FReplayEntityState(), Found);
+				OutCurrent[Found].Id = Id;
+			}
+			ReadFields(Ar, Mask, OutCurrent[Found]);
+		}
+	}
+}
+
+void FReplayEntityState::SetLocation(const FVector& InLocation)
+{
+	Location = FIntVector(FMath::RoundToInt(InLocation.X * 10.f), FMath::RoundToInt(InLocation.Y * 10.f), FMath::RoundToInt(InLocation.Z * 10.f));
+}
+
+void FReplayEntityState::SetRotation(const FRotator& InRotation)
+{
+	Pitch = FRotator::CompressAxisToShort(InRotation.Pitch);
+	Yaw = FRotator::CompressAxisToShort(InRotation.Yaw);
+	Roll = FRotator::CompressAxisToShort(InRotation.Roll);
+}
+
+FVector FReplayEntityState::GetLocation() const
+{
+	return FVector(Location) * 0.1f;
+}
+
+FRotator FReplayEntityState::GetRotation() const
+{
+	return FRotator(FRotator::DecompressAxisFromShort(Pitch), FRotator::DecompressAxisFromShort(Yaw), FRotator::DecompressAxisFromShort(Roll));
+}
+
+void FReplaySnapshotCodec::Encode(FArchive& Ar, const FReplaySnapshot& Previous, const FReplaySnapshot& Current)
+{
+	float Time = Current.Time;
+	Ar << Time;
+
+	EncodeTable(Ar, Previous.Enemies, Current.Enemies);
+	EncodeTable(Ar, Previous.Lamps, Current.Lamps);
+	EncodeTable(Ar, Previous.Players, Current.Players);
+
+	WriteUnsigned(Ar, Current.Events.Num());
+	for (const FReplayEvent& Event : Current.Events)
+	{
+		uint8 Type = static_cast<uint8>(Event.Type);
+		Ar << Type;
+		WriteFields(Ar, Field_Location | Field_Rotation, FReplayEntityState(), Event.State);
+	}
+}
+
+void FReplaySnapshotCodec::Decode(FArchive& Ar, const FReplaySnapshot& Previous, FReplaySnapshot& OutCurrent)
+{
+	Ar << OutCurrent.Time;
+
+	DecodeTable(Ar, Previous.Enemies, OutCurrent.Enemies);
+	DecodeTable(Ar, Previous.Lamps, OutCurrent.Lamps);
+	DecodeTable(Ar, Previous.Players, OutCurrent.Players);
+
+	OutCurrent.Events.Reset();
+	const uint32 NumEvents = ReadUnsigned(Ar);
+	for (uint32 Index = 0; Index < NumEvents && !Ar.IsError(); ++Index)
+	{
+		FReplayEvent Event;
+		uint8 Type = 0;
+		Ar << Type;
+		Event.Type = static_cast<EReplayEvent>(Type);
+		ReadFields(Ar, Field_Location | Field_Rotation, Event.State);
+		OutCurrent.Events.Add(Event);
+	}
+}
+
+namespace
+{
+	void GatherLamps(UWorld* World, TArray<TWeakObjectPtr<ADynamicLight>>& OutLamps)
+	{
+		TArray<ADynamicLight*> Found;
+		for (TActorIterator<ADynamicLight> It(World); It; ++It)
+		{
+			Found.Add(*It);
+		}
+		Found.Sort([](const ADynamicLight& A, const ADynamicLight& B) { return A.GetFName().LexicalLess(B.GetFName()); });
+
+		OutLamps.Reset();
+		for (ADynamicLight* Lamp : Found)
+		{
+			OutLamps.Add(Lamp);
+		}
+	}
+}
+
+FReplayRecorder::FReplayRecorder(UWorld* InWorld, const FString& InFilename)
+	: World(InWorld)
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	PlatformFile.CreateDirectoryTree(*FPaths::GetPath(InFilename));
+	FileHandle = PlatformFile.OpenWrite(*InFilename);
+	if (FileHandle == nullptr)
+	{
+		UE_LOG(LogFuturum, Error, TEXT("Could not open replay file %s for writing"), *InFilename);
+		return;
+	}
+
+	uint32 Magic = FReplaySnapshotCodec::FileMagic;
+	FileHandle->Write(reinterpret_cast<const uint8*>(&Magic), sizeof(Magic));
+
+	GatherLamps(World, Lamps);
+
+	FramesQueued = FPlatformProcess::GetSynchEventFromPool();
+	Thread = FRunnableThread::Create(this, TEXT("FuturumReplayWriter"), 0, TPri_BelowNormal);
+	UE_LOG(LogFuturum, Log, TEXT("Recording replay to %s"), *InFilename);
+}
+
+FReplayRecorder::~FReplayRecorder()
+{
+	if (Thread)
+	{
+		Stop();
+		Thread->WaitForCompletion();
+		delete Thread;
+	}
+	if (FramesQueued)
+	{
+		FPlatformProcess::ReturnSynchEventToPool(FramesQueued);
+	}
+	delete FileHandle;
+}
+
+void FReplayRecorder::AddEvent(EReplayEvent Type, const FVector& Location, const FRotator& Rotation)
+{
+	FReplayEvent Event;
+	Event.Type = Type;
+	Event.State.SetLocation(Location);
+	Event.State.SetRotation(Rotation);
+	PendingEvents.Add(Event);
+}
+
+void FReplayRecorder::RecordFrame()
+{
+	if (!IsRecording())
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_ReplayRecordFrame);
+
+	FReplaySnapshot Snapshot;
+	Capture(Snapshot);
+	Snapshot.Events = MoveTemp(PendingEvents);
+	PendingEvents.Reset();
+
+	TArray<uint8> Frame;
+	FMemoryWriter Writer(Frame);
+	FReplaySnapshotCodec::Encode(Writer, PreviousSnapshot, Snapshot);
+	INC_DWORD_STAT_BY(STAT_ReplayBytesRecorded, Frame.Num());
+
+	Frames.Enqueue(MoveTemp(Frame));
+	FramesQueued->Trigger();
+	PreviousSnapshot = MoveTemp(Snapshot);
+}
+
+void FReplayRecorder::Capture(FReplaySnapshot& OutSnapshot) const
+{
+	OutSnapshot.Time = World->GetTimeSeconds();
+
+	const AFuturumGameState* GameState = World->GetGameState<AFuturumGameState>();
+	if (GameState)
+	{
+		for (const ABallEnemy* Enemy : GameState->GetEnemies())
+		{
+			FReplayEntityState& State = OutSnapshot.Enemies[OutSnapshot.Enemies.AddDefaulted()];
+			State.Id = Enemy->GetUniqueID();
+			State.SetLocation(Enemy->GetActorLocation());
+			State.SetRotation(Enemy->GetActorRotation());
+			State.Health = FMath::RoundToInt(Enemy->CurrentHealth * 10.f);
+		}
+		OutSnapshot.Enemies.Sort([](const FReplayEntityState& A, const FReplayEntityState& B) { return A.Id < B.Id; });
+	}
+
+	for (int32 Index = 0; Index < Lamps.Num(); ++Index)
+	{
+		const ADynamicLight* Lamp = Lamps[Index].Get();
+		if (Lamp)
+		{
+			FReplayEntityState& State = OutSnapshot.Lamps[OutSnapshot.Lamps.AddDefaulted()];
+			State.Id = Index;
+			State.Color = Lamp->LightColor.ToFColor(false).DWColor();
+			State.Flags = Lamp->bLightOn ? 1 : 0;
+		}
+	}
+
+	for (FConstPlayerControllerIterator It = World->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APawn* Pawn = It->IsValid() ? (*It)->GetPawn() : nullptr;
+		if (Pawn)
+		{
+			FReplayEntityState& State = OutSnapshot.Players[OutSnapshot.Players.AddDefaulted()];
+			State.Id = Pawn->GetUniqueID();
+			State.SetLocation(Pawn->GetActorLocation());
+			State.SetRotation(Pawn->GetControlRotation());
+		}
+	}
+	OutSnapshot.Players.Sort([](const FReplayEntityState& A, const FReplayEntityState& B) { return A.Id < B.Id; });
+}
+
+uint32 FReplayRecorder::Run()
+{
+	bool bDone = false;
+	while (!bDone)
+	{
+		bDone = bStopping;
+		FramesQueued->Wait(100);
+
+		TArray<uint8> Frame;
+		while (Frames.Dequeue(Frame))
+		{
+			FileHandle->Write(Frame.GetData(), Frame.Num());
+		}
+	}
+	return 0;
+}
+
+void FReplayRecorder::Stop()
+{
+	bStopping = true;
+	FramesQueued->Trigger();
+}
+
+FReplayPlayer::FReplayPlayer(UWorld* InWorld, TSubclassOf<ABallEnemy> InEnemyClass)
+	: World(InWorld)
+	, EnemyClass(InEnemyClass)
+{
+}
+
+bool FReplayPlayer::Load(const FString& Filename)
+{
+	if (!FFileHelper::LoadFileToArray(Data, *Filename))
+	{
+		UE_LOG(LogFuturum, Error, TEXT("Could not read replay file %s"), *Filename);
+		return false;
+	}
+
+	Reader = MakeUnique<FMemoryReader>(Data);
+	uint32 Magic = 0;
+	*Reader << Magic;
+	if (Magic != FReplaySnapshotCodec::FileMagic)
+	{
+		UE_LOG(LogFuturum, Error, TEXT("%s is not a Futurum replay"), *Filename);
+		Reader.Reset();
+		return false;
+	}
+
+	GatherLamps(World, Lamps);
+	ReadNextSnapshot();
+	PlaybackTime = NextSnapshot.Time;
+	UE_LOG(LogFuturum, Log, TEXT("Playing replay %s"), *Filename);
+	return true;
+}
+
+void FReplayPlayer::ReadNextSnapshot()
+{
+	bHasNextSnapshot = false;
+	if (Reader.IsValid() && !Reader->AtEnd())
+	{
+		FReplaySnapshotCodec::Decode(*Reader, CurrentSnapshot, NextSnapshot);
+		bHasNextSnapshot = !Reader->IsError();
+	}
+}
+
+void FReplayPlayer::Tick(float DeltaSeconds)
+{
+	PlaybackTime += DeltaSeconds;
+	while (bHasNextSnapshot && NextSnapshot.Time <= PlaybackTime)
+	{
+		Swap(CurrentSnapshot, NextSnapshot);
+		ApplySnapshot(CurrentSnapshot);
+		ReadNextSnapshot();
+	}
+}
+
+void FReplayPlayer::ApplySnapshot(const FReplaySnapshot& Snapshot)
+{
+	SCOPE_CYCLE_COUNTER(STAT_ReplayPlaybackFrame);
+
+	// Enemies follow the recording, physics is off so nothing fights over them
+	TSet<uint32> Seen;
+	for (const FReplayEntityState& State : Snapshot.Enemies)
+	{
+		Seen.Add(State.Id);
+		TWeakObjectPtr<ABallEnemy>& Enemy = Enemies.FindOrAdd(State.Id);
+		if (!Enemy.IsValid())
+		{
+			FActorSpawnParameters SpawnParams;
+			SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+			SpawnParams.ObjectFlags |= RF_Transient;
+			Enemy = World->SpawnActor<ABallEnemy>(EnemyClass, State.GetLocation(), State.GetRotation(), SpawnParams);
+			if (!Enemy.IsValid())
+			{
+				continue;
+			}
+			Enemy->StaticMesh->SetSimulatePhysics(false);
+		}
+		Enemy->SetActorLocationAndRotation(State.GetLocation(), State.GetRotation(), false, nullptr, ETeleportType::TeleportPhysics);
+		Enemy->SetHealth(State.Health * 0.1f);
+	}
+	for (auto It = Enemies.CreateIterator(); It; ++It)
+	{
+		if (!Seen.Contains(It.Key()))
+		{
+			if (It.Value().IsValid())
+			{
+				It.Value()->Destroy();
+			}
+			It.RemoveCurrent();
+		}
+	}
+
+	for (const FReplayEntityState& State : Snapshot.Lamps)
+	{
+		ADynamicLight* Lamp = Lamps.IsValidIndex(State.Id) ? Lamps[State.Id].Get() : nullptr;
+		if (Lamp)
+		{
+			Lamp->SetLightColor(FColor(State.Color).ReinterpretAsLinear());
+			Lamp->SetState((State.Flags & 1) != 0);
+		}
+	}
+
+	// Projectiles are simulated again, their hits are not replayed
+	for (const FReplayEvent& Event : Snapshot.Events)
+	{
+		if (Event.Type == EReplayEvent::ProjectileSpawned)
+		{
+			FActorSpawnParameters SpawnParams;
+			SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+			SpawnParams.ObjectFlags |= RF_Transient;
+			World->SpawnActor<AFuturumProjectile>(AFuturumProjectile::StaticClass(), Event.State.GetLocation(), Event.State.GetRotation(), SpawnParams);
+		}
+	}
+}
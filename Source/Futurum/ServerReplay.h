@@ -0,0 +1,146 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "HAL/ThreadSafeBool.h"
+#include "Containers/Queue.h"
+
+class ABallEnemy;
+class ADynamicLight;
+class IFileHandle;
+class FRunnableThread;
+class FEvent;
+
+/** One replicated object in a replay frame, quantized the way it is stored */
+struct FReplayEntityState
+{
+	uint32 Id = 0;
+	/** Tenths of a world unit */
+	FIntVector Location = FIntVector::ZeroValue;
+	uint16 Pitch = 0;
+	uint16 Yaw = 0;
+	uint16 Roll = 0;
+	/** Tenths of a health point */
+	int32 Health = 0;
+	uint32 Color = 0;
+	uint8 Flags = 0;
+
+	void SetLocation(const FVector& InLocation);
+	void SetRotation(const FRotator& InRotation);
+	FVector GetLocation() const;
+	FRotator GetRotation() const;
+};
+
+enum class EReplayEvent : uint8
+{
+	ProjectileSpawned,
+	ProjectileHit
+};
+
+struct FReplayEvent
+{
+	EReplayEvent Type = EReplayEvent::ProjectileSpawned;
+	FReplayEntityState State;
+};
+
+/** Everything recorded for one server tick */
+struct FReplaySnapshot
+{
+	float Time = 0.f;
+	/** Sorted by Id */
+	TArray<FReplayEntityState> Enemies;
+	/** Indexed by lamp name order, see FReplayRecorder */
+	TArray<FReplayEntityState> Lamps;
+	/** Sorted by Id */
+	TArray<FReplayEntityState> Players;
+	TArray<FReplayEvent> Events;
+};
+
+/** Writes and reads snapshots as per field deltas against the previous snapshot. */
+struct FReplaySnapshotCodec
+{
+	static const uint32 FileMagic;
+
+	static void Encode(FArchive& Ar, const FReplaySnapshot& Previous, const FReplaySnapshot& Current);
+
+	static void Decode(FArchive& Ar, const FReplaySnapshot& Previous, FReplaySnapshot& OutCurrent);
+};
+
+/**
+ * Captures the Futurum world every server tick and streams the encoded frames to disk
+ * from a writer thread, so the game thread only pays for capturing and encoding.
+ */
+class FUTURUM_API FReplayRecorder : public FRunnable
+{
+public:
+	FReplayRecorder(UWorld* InWorld, const FString& InFilename);
+
+	virtual ~FReplayRecorder();
+
+	bool IsRecording() const { return FileHandle != nullptr; }
+
+	/** Queues an event for the next frame */
+	void AddEvent(EReplayEvent Type, const FVector& Location, const FRotator& Rotation);
+
+	/** Captures and queues a frame, call once per server tick */
+	void RecordFrame();
+
+	// FRunnable interface
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+private:
+	void Capture(FReplaySnapshot& OutSnapshot) const;
+
+	UWorld* World;
+
+	/** Level lamps sorted by name, so playback can find them again */
+	TArray<TWeakObjectPtr<ADynamicLight>> Lamps;
+
+	FReplaySnapshot PreviousSnapshot;
+	TArray<FReplayEvent> PendingEvents;
+
+	IFileHandle* FileHandle = nullptr;
+	FRunnableThread* Thread = nullptr;
+	FEvent* FramesQueued = nullptr;
+	TQueue<TArray<uint8>, EQueueMode::Spsc> Frames;
+	FThreadSafeBool bStopping;
+};
+
+/**
+ * Replays a recorded match in a live world: enemies are driven along the recorded path,
+ * lamps follow their recorded state and projectiles are spawned again and simulated,
+ * so the hits, explosions and physics cost of the original match show up in a profile.
+ */
+class FUTURUM_API FReplayPlayer
+{
+public:
+	FReplayPlayer(UWorld* InWorld, TSubclassOf<ABallEnemy> InEnemyClass);
+
+	bool Load(const FString& Filename);
+
+	/** Applies every frame recorded up to the current playback time */
+	void Tick(float DeltaSeconds);
+
+	bool IsFinished() const { return !bHasNextSnapshot; }
+
+private:
+	void ReadNextSnapshot();
+
+	void ApplySnapshot(const FReplaySnapshot& Snapshot);
+
+	UWorld* World;
+	TSubclassOf<ABallEnemy> EnemyClass;
+
+	TArray<uint8> Data;
+	TUniquePtr<FArchive> Reader;
+	FReplaySnapshot CurrentSnapshot;
+	FReplaySnapshot NextSnapshot;
+	bool bHasNextSnapshot = false;
+	float PlaybackTime = 0.f;
+
+	TArray<TWeakObjectPtr<ADynamicLight>> Lamps;
+	TMap<uint32, TWeakObjectPtr<ABallEnemy>> Enemies;
+};
@@ -0,0 +1,99 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "SpawnLocationSolver.h"
+#include "Futurum.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Ready spawn points"), STAT_ReadySpawnPoints, STATGROUP_Futurum);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Spawn point queries"), STAT_SpawnPointQueries, STATGROUP_Futurum);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Spawn points rejected"), STAT_SpawnPointsRejected, STATGROUP_Futurum);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Spawn point queries lost"), STAT_SpawnPointQueriesLost, STATGROUP_Futurum);
+
+void FSpawnLocationSolver::Tick(UWorld* World)
+{
+	for (int32 Index = PendingQueries.Num() - 1; Index >= 0; --Index)
+	{
+		FOverlapDatum Result;
+		if (!World->QueryOverlapData(PendingQueries[Index], Result))
+		{
+			// Results are only kept for a frame, a query missed then would hold its place in the pool forever
+			if (!World->IsTraceHandleValid(PendingQueries[Index], true))
+			{
+				PendingQueries.RemoveAtSwap(Index);
+				INC_DWORD_STAT(STAT_SpawnPointQueriesLost);
+			}
+			continue;
+		}
+		PendingQueries.RemoveAtSwap(Index);
+
+		if (Result.OutOverlaps.Num() == 0 && IsAwayFromPlayers(World, Result.Pos))
+		{
+			FSpawnPoint Point;
+			Point.Location = Result.Pos;
+			Point.ValidatedTime = World->GetTimeSeconds();
+			ReadyPoints.Add(Point);
+		}
+		else
+		{
+			INC_DWORD_STAT(STAT_SpawnPointsRejected);
+		}
+	}
+
+	// Oldest points first, they were added in order
+	const float Now = World->GetTimeSeconds();
+	int32 NumStale = 0;
+	while (NumStale < ReadyPoints.Num() && Now - ReadyPoints[NumStale].ValidatedTime > MaxAge)
+	{
+		++NumStale;
+	}
+	ReadyPoints.RemoveAt(0, NumStale, false);
+
+	static const FCollisionObjectQueryParams ObjectParams(FCollisionObjectQueryParams::AllObjects);
+	static const FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(SpawnPointOverlap), false);
+	for (int32 Query = 0; Query < QueriesPerTick && ReadyPoints.Num() + PendingQueries.Num() < PoolSize; ++Query)
+	{
+		const FVector Candidate(FMath::RandRange(-Extent, Extent), FMath::RandRange(-Extent, Extent), Height);
+		PendingQueries.Add(World->AsyncOverlapByObjectType(Candidate, FQuat::Identity, ObjectParams, FCollisionShape::MakeSphere(Clearance), QueryParams));
+		INC_DWORD_STAT(STAT_SpawnPointQueries);
+	}
+
+	SET_DWORD_STAT(STAT_ReadySpawnPoints, ReadyPoints.Num());
+}
+
+bool FSpawnLocationSolver::Pop(UWorld* World, FVector& OutLocation)
+{
+	// Players may have walked up to a point since it was checked
+	for (int32 Index = 0; Index < ReadyPoints.Num(); ++Index)
+	{
+		if (IsAwayFromPlayers(World, ReadyPoints[Index].Location))
+		{
+			OutLocation = ReadyPoints[Index].Location;
+			ReadyPoints.RemoveAt(Index, 1, false);
+			SET_DWORD_STAT(STAT_ReadySpawnPoints, ReadyPoints.Num());
+			return true;
+		}
+	}
+	return false;
+}
+
+void FSpawnLocationSolver::Reset()
+{
+	ReadyPoints.Reset();
+	PendingQueries.Reset();
+	SET_DWORD_STAT(STAT_ReadySpawnPoints, 0);
+}
+
+bool FSpawnLocationSolver::IsAwayFromPlayers(UWorld* World, const FVector& Location) const
+{
+	for (FConstPlayerControllerIterator It = World->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APawn* Pawn = It->Get() ? It->Get()->GetPawn() : nullptr;
+		if (Pawn && FVector::DistSquared(Pawn->GetActorLocation(), Location) < FMath::Square(MinPlayerDistance))
+		{
+			return false;
+		}
+	}
+	return true;
+}
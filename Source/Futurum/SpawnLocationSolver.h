@@ -0,0 +1,58 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "WorldCollision.h"
+
+class UWorld;
+
+/**
+ * Keeps a few enemy spawn points ready ahead of time. Candidates are checked with async
+ * overlaps, which the physics scene runs off the game thread and answers a frame later.
+ * Ready points go stale after a while and are replaced a few at a time, so the game mode
+ * only has to pop one when it spawns.
+ */
+class FUTURUM_API FSpawnLocationSolver
+{
+public:
+	/** Half size of the square candidates are picked in, and their height */
+	float Extent = 1250.f;
+	float Height = 500.f;
+
+	/** Room a candidate needs free of any geometry or actor */
+	float Clearance = 100.f;
+
+	/** Closest a spawn point may be to a player */
+	float MinPlayerDistance = 800.f;
+
+	int32 PoolSize = 8;
+
+	/** Most overlap queries started per tick */
+	int32 QueriesPerTick = 2;
+
+	/** Time after which a ready point is dropped, the world around it may have changed */
+	float MaxAge = 3.f;
+
+	/** Collects finished queries and starts new ones */
+	void Tick(UWorld* World);
+
+	/** Takes a ready point away from players, returns false if there is none */
+	bool Pop(UWorld* World, FVector& OutLocation);
+
+	void Reset();
+
+	FORCEINLINE SIZE_T GetAllocatedSize() const { return ReadyPoints.GetAllocatedSize() + PendingQueries.GetAllocatedSize(); }
+
+private:
+	struct FSpawnPoint
+	{
+		FVector Location;
+		float ValidatedTime;
+	};
+
+	bool IsAwayFromPlayers(UWorld* World, const FVector& Location) const;
+
+	TArray<FSpawnPoint> ReadyPoints;
+	TArray<FTraceHandle> PendingQueries;
+};
@@ -0,0 +1,287 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TimingWheel.h"
+#include "Futurum.h"
+#include "TimerManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Containers/Ticker.h"
+
+DECLARE_CYCLE_STAT(TEXT("Timing wheel advance"), STAT_TimingWheelAdvance, STATGROUP_Futurum);
+
+namespace
+{
+	const float BenchmarkMaxDelay = 10.f;
+	const float BenchmarkFrameTime = 1.f / 60.f;
+
+	/**
+	 * Run half of the timer benchmark. The timer manager only ticks once per engine frame, so both
+	 * schedulers are advanced by one simulated 60 Hz frame on every real frame.
+	 */
+	struct FTimerBenchmark
+	{
+		int32 NumTimers = 0;
+		FTimingWheel Wheel;
+		FTimerManager TimerManager;
+		int32 WheelFired = 0;
+		int32 TimerManagerFired = 0;
+		double WheelRunTime = 0.0;
+		double TimerManagerRunTime = 0.0;
+		float Time = 0.f;
+
+		bool Tick(float DeltaTime)
+		{
+			double Start = FPlatformTime::Seconds();
+			Wheel.Advance(BenchmarkFrameTime);
+			WheelRunTime += FPlatformTime::Seconds() - Start;
+
+			Start = FPlatformTime::Seconds();
+			TimerManager.Tick(BenchmarkFrameTime);
+			TimerManagerRunTime += FPlatformTime::Seconds() - Start;
+
+			Time += BenchmarkFrameTime;
+			if (Time <= BenchmarkMaxDelay + BenchmarkFrameTime)
+			{
+				return true;
+			}
+
+			UE_LOG(LogFuturum, Log, TEXT("%d timers run over 10 s of frames: timing wheel %.3f ms, %d fired, timer manager %.3f ms, %d fired"),
+				NumTimers, WheelRunTime * 1000.0, WheelFired, TimerManagerRunTime * 1000.0, TimerManagerFired);
+			if (WheelFired != TimerManagerFired)
+			{
+				UE_LOG(LogFuturum, Warning, TEXT("Timing wheel fired %d timers, the timer manager %d, the run times are not comparable"), WheelFired, TimerManagerFired);
+			}
+			return false;
+		}
+	};
+
+	void BenchmarkTimers(const TArray<FString>& Args)
+	{
+		const int32 NumTimers = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 10000;
+
+		FRandomStream Random(NumTimers);
+		TArray<float> Delays;
+		for (int32 Index = 0; Index < NumTimers; ++Index)
+		{
+			Delays.Add(Random.FRandRange(0.f, BenchmarkMaxDelay));
+		}
+
+		TSharedRef<FTimerBenchmark> Benchmark = MakeShared<FTimerBenchmark>();
+		FTimerBenchmark* RawBenchmark = &Benchmark.Get();
+		Benchmark->NumTimers = NumTimers;
+
+		// Schedule everything and cancel every other timer now, the rest runs out over the next frames
+		{
+			TArray<FTimingWheelHandle> Handles;
+			Handles.Reserve(NumTimers);
+
+			double Start = FPlatformTime::Seconds();
+			for (float Delay : Delays)
+			{
+				Handles.Add(Benchmark->Wheel.Schedule(Delay, [RawBenchmark]() { ++RawBenchmark->WheelFired; }));
+			}
+			const double ScheduleTime = FPlatformTime::Seconds() - Start;
+
+			Start = FPlatformTime::Seconds();
+			for (int32 Index = 0; Index < Handles.Num(); Index += 2)
+			{
+				Benchmark->Wheel.Cancel(Handles[Index]);
+			}
+			const double CancelTime = FPlatformTime::Seconds() - Start;
+
+			UE_LOG(LogFuturum, Log, TEXT("Timing wheel, %d timers: schedule %.3f ms, cancel half %.3f ms"),
+				NumTimers, ScheduleTime * 1000.0, CancelTime * 1000.0);
+		}
+
+		{
+			TArray<FTimerHandle> Handles;
+			Handles.SetNum(NumTimers);
+
+			double Start = FPlatformTime::Seconds();
+			for (int32 Index = 0; Index < NumTimers; ++Index)
+			{
+				Benchmark->TimerManager.SetTimer(Handles[Index], FTimerDelegate::CreateLambda([RawBenchmark]() { ++RawBenchmark->TimerManagerFired; }), FMath::Max(Delays[Index], 0.001f), false);
+			}
+			const double ScheduleTime = FPlatformTime::Seconds() - Start;
+
+			Start = FPlatformTime::Seconds();
+			for (int32 Index = 0; Index < Handles.Num(); Index += 2)
+			{
+				Benchmark->TimerManager.ClearTimer(Handles[Index]);
+			}
+			const double CancelTime = FPlatformTime::Seconds() - Start;
+
+			UE_LOG(LogFuturum, Log, TEXT("Timer manager, %d timers: schedule %.3f ms, cancel half %.3f ms"),
+				NumTimers, ScheduleTime * 1000.0, CancelTime * 1000.0);
+		}
+
+		FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([Benchmark](float DeltaTime)
+		{
+			return Benchmark->Tick(DeltaTime);
+		}));
+	}
+}
+
+static FAutoConsoleCommand BenchmarkTimersCommand(
+	TEXT("Futurum.BenchTimers"),
+	TEXT("Schedules, cancels and runs timers through the timing wheel and the engine timer manager. Takes the number of timers, 10000 by default, the run times are logged once 10 s of frames have gone by."),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkTimers));
+
+FTimingWheel::FTimingWheel(float InResolution)
+	: Resolution(FMath::Max(InResolution, KINDA_SMALL_NUMBER))
+{
+	for (int32& Slot : Slots)
+	{
+		Slot = INDEX_NONE;
+	}
+}
+
+FTimingWheelHandle FTimingWheel::Schedule(float Delay, TFunction<void()>&& Callback)
+{
+	int32 Index = FirstFree;
+	if (Index != INDEX_NONE)
+	{
+		FirstFree = Timers[Index].Next;
+	}
+	else
+	{
+		Index = Timers.AddDefaulted();
+	}
+
+	// A timer never runs on the tick it was scheduled on, so a callback can not keep its tick going
+	const uint64 Ticks = (uint64)FMath::Clamp<double>(FMath::CeilToDouble((Delay + Accumulated) / Resolution), 1.0, (double)MaxTicks);
+
+	FTimer& Timer = Timers[Index];
+	Timer.ExpireTick = CurrentTick + Ticks;
+	Timer.Callback = MoveTemp(Callback);
+	Link(Index);
+	++NumScheduled;
+
+	FTimingWheelHandle Handle;
+	Handle.Index = Index;
+	Handle.Serial = Timer.Serial;
+	return Handle;
+}
+
+bool FTimingWheel::Cancel(FTimingWheelHandle& Handle)
+{
+	const bool bScheduled = Handle.IsValid() && Timers.IsValidIndex(Handle.Index)
+		&& Timers[Handle.Index].Serial == Handle.Serial && Timers[Handle.Index].Slot != INDEX_NONE;
+	if (bScheduled)
+	{
+		Unlink(Handle.Index);
+		Free(Handle.Index);
+	}
+	Handle = FTimingWheelHandle();
+	return bScheduled;
+}
+
+float FTimingWheel::GetTimeRemaining(const FTimingWheelHandle& Handle) const
+{
+	const bool bScheduled = Handle.IsValid() && Timers.IsValidIndex(Handle.Index)
+		&& Timers[Handle.Index].Serial == Handle.Serial && Timers[Handle.Index].Slot != INDEX_NONE;
+	if (!bScheduled)
+	{
+		return -1.f;
+	}
+	return FMath::Max((Timers[Handle.Index].ExpireTick - CurrentTick) * Resolution - Accumulated, 0.f);
+}
+
+void FTimingWheel::Advance(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_TimingWheelAdvance);
+
+	Accumulated += DeltaTime;
+	while (Accumulated >= Resolution)
+	{
+		Accumulated -= Resolution;
+		++CurrentTick;
+
+		// Each level wrapping around brings the next slot of the level above down
+		for (int32 Level = 1; Level < Levels && (CurrentTick & ((1ull << (SlotBits * Level)) - 1)) == 0; ++Level)
+		{
+			Cascade(Level);
+		}
+
+		int32& Head = Slots[CurrentTick & (SlotsPerLevel - 1)];
+		while (Head != INDEX_NONE)
+		{
+			const int32 Index = Head;
+			Unlink(Index);
+			TFunction<void()> Callback = MoveTemp(Timers[Index].Callback);
+			Free(Index);
+			Callback();
+		}
+	}
+}
+
+void FTimingWheel::Reset()
+{
+	Timers.Reset();
+	FirstFree = INDEX_NONE;
+	NumScheduled = 0;
+	for (int32& Slot : Slots)
+	{
+		Slot = INDEX_NONE;
+	}
+}
+
+void FTimingWheel::Link(int32 Index)
+{
+	FTimer& Timer = Timers[Index];
+	const uint64 Delta = Timer.ExpireTick - CurrentTick;
+	int32 Level = 0;
+	while (Level < Levels - 1 && Delta >= (1ull << (SlotBits * (Level + 1))))
+	{
+		++Level;
+	}
+
+	Timer.Slot = Level * SlotsPerLevel + (int32)((Timer.ExpireTick >> (SlotBits * Level)) & (SlotsPerLevel - 1));
+	Timer.Prev = INDEX_NONE;
+	Timer.Next = Slots[Timer.Slot];
+	if (Timer.Next != INDEX_NONE)
+	{
+		Timers[Timer.Next].Prev = Index;
+	}
+	Slots[Timer.Slot] = Index;
+}
+
+void FTimingWheel::Unlink(int32 Index)
+{
+	FTimer& Timer = Timers[Index];
+	if (Timer.Prev != INDEX_NONE)
+	{
+		Timers[Timer.Prev].Next = Timer.Next;
+	}
+	else
+	{
+		Slots[Timer.Slot] = Timer.Next;
+	}
+	if (Timer.Next != INDEX_NONE)
+	{
+		Timers[Timer.Next].Prev = Timer.Prev;
+	}
+	Timer.Slot = INDEX_NONE;
+}
+
+void FTimingWheel::Free(int32 Index)
+{
+	FTimer& Timer = Timers[Index];
+	Timer.Callback = nullptr;
+	++Timer.Serial;
+	Timer.Next = FirstFree;
+	FirstFree = Index;
+	--NumScheduled;
+}
+
+void FTimingWheel::Cascade(int32 Level)
+{
+	int32& Head = Slots[Level * SlotsPerLevel + (int32)((CurrentTick >> (SlotBits * Level)) & (SlotsPerLevel - 1))];
+	int32 Index = Head;
+	Head = INDEX_NONE;
+	while (Index != INDEX_NONE)
+	{
+		const int32 Next = Timers[Index].Next;
+		Link(Index);
+		Index = Next;
+	}
+}
@@ -0,0 +1,83 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/** Refers to a scheduled timer, stays safe to cancel after the timer ran */
+struct FTimingWheelHandle
+{
+	int32 Index = INDEX_NONE;
+	uint32 Serial = 0;
+
+	FORCEINLINE bool IsValid() const { return Index != INDEX_NONE; }
+};
+
+/**
+ * Hierarchical timing wheel for gameplay timers with native callbacks. Four levels of 64 slots,
+ * each slot a linked list of timers in one pooled array, give constant time scheduling and
+ * cancelling. A timer sits in the level matching how far away it is, and moves down a level
+ * each time the level below wraps around, until it runs from the first level.
+ */
+class FUTURUM_API FTimingWheel
+{
+public:
+	/** Resolution is the length of a tick in seconds, timers run at the first tick at or after their delay */
+	explicit FTimingWheel(float InResolution = 1.f / 60.f);
+
+	FTimingWheelHandle Schedule(float Delay, TFunction<void()>&& Callback);
+
+	/** Returns false if the timer already ran or was cancelled, resets the handle either way */
+	bool Cancel(FTimingWheelHandle& Handle);
+
+	/** Runs every timer due within the time, callbacks may schedule and cancel timers */
+	void Advance(float DeltaTime);
+
+	/** Drops every timer without running it */
+	void Reset();
+
+	FORCEINLINE int32 Num() const { return NumScheduled; }
+
+	/** Seconds until the timer runs, -1 if it already ran or was cancelled */
+	float GetTimeRemaining(const FTimingWheelHandle& Handle) const;
+
+	FORCEINLINE SIZE_T GetAllocatedSize() const { return Timers.GetAllocatedSize(); }
+
+private:
+	static const int32 SlotBits = 6;
+	static const int32 SlotsPerLevel = 1 << SlotBits;
+	static const int32 Levels = 4;
+
+	/** Farthest a timer can be, in ticks */
+	static const uint64 MaxTicks = (1ull << (SlotBits * Levels)) - 1;
+
+	struct FTimer
+	{
+		uint64 ExpireTick = 0;
+		TFunction<void()> Callback;
+		int32 Prev = INDEX_NONE;
+		int32 Next = INDEX_NONE;
+		int32 Slot = INDEX_NONE;
+		uint32 Serial = 0;
+	};
+
+	void Link(int32 Index);
+
+	void Unlink(int32 Index);
+
+	void Free(int32 Index);
+
+	/** Moves the timers of a slot down to the levels below */
+	void Cascade(int32 Level);
+
+	float Resolution;
+	float Accumulated = 0.f;
+	uint64 CurrentTick = 0;
+
+	TArray<FTimer> Timers;
+	int32 FirstFree = INDEX_NONE;
+	int32 NumScheduled = 0;
+
+	/** First timer of every slot, level after level */
+	int32 Slots[SlotsPerLevel * Levels];
+};
@@ -0,0 +1,39 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Classic token bucket used to rate limit client requests on the server.
+ * Holds up to Capacity tokens and refills at RefillRate tokens per second.
+ */
+struct FTokenBucket
+{
+	float Capacity = 1.f;
+	float RefillRate = 1.f;
+	float Tokens = 1.f;
+	float LastRefillTime = 0.f;
+
+	FTokenBucket() {}
+
+	FTokenBucket(float InCapacity, float InRefillRate)
+		: Capacity(InCapacity)
+		, RefillRate(InRefillRate)
+		, Tokens(InCapacity)
+	{
+	}
+
+	/** Takes a token if one is available at time Now. */
+	bool TryConsume(float Now)
+	{
+		Tokens = FMath::Min(Capacity, Tokens + FMath::Max(Now - LastRefillTime, 0.f) * RefillRate);
+		LastRefillTime = Now;
+		if (Tokens < 1.f)
+		{
+			return false;
+		}
+		Tokens -= 1.f;
+		return true;
+	}
+};